@@ -0,0 +1,114 @@
+#include "assetloader.h"
+#include "glutils.h"
+
+#include <GLFW/glfw3.h>
+
+#include <cstdlib>
+#include <iostream>
+
+AssetLoader::AssetLoader(GLFWwindow *mainWindow) : context(nullptr) {
+    // Same hints as the main window, minus visibility
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "Asset loader", NULL, mainWindow);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context) {
+        std::cerr << "Unable to create the asset loader's shared OpenGL context." << std::endl;
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    worker = std::thread(&AssetLoader::run, this);
+}
+
+AssetLoader::~AssetLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+
+    for (Job &job : finished) {
+        if (job.fence) glDeleteSync(job.fence);
+    }
+    glfwDestroyWindow(context);
+}
+
+void AssetLoader::enqueue(Work work, Ready ready) {
+    Job job;
+    job.work = std::move(work);
+    job.ready = std::move(ready);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void AssetLoader::poll() {
+    for (;;) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished.empty()) return;
+
+            // Zero timeout: a job whose uploads are still in flight waits for a later frame
+            GLsync fence = finished.front().fence;
+            if (fence) {
+                GLenum state = glClientWaitSync(fence, 0, 0);
+                if (state == GL_TIMEOUT_EXPIRED) return;
+                glDeleteSync(fence);
+            }
+            job = std::move(finished.front());
+            finished.pop_front();
+        }
+        job.ready(job.ok);
+    }
+}
+
+size_t AssetLoader::pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued.size() + running + finished.size();
+}
+
+void AssetLoader::run() {
+    glfwMakeContextCurrent(context);
+
+#ifndef __APPLE__
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    if (flags & GL_CONTEXT_FLAG_DEBUG_BIT) {
+        glDebugMessageCallback(GLUtils::debugCallback, nullptr);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    }
+#endif
+
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (stopping) break;
+            job = std::move(queued.front());
+            queued.pop_front();
+            running = 1;
+        }
+
+        job.ok = job.work();
+
+        // The flush makes sure the fence, and the uploads before it, reach
+        // the GPU; the render thread only ever polls it
+        if (job.ok) {
+            job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(std::move(job));
+            running = 0;
+        }
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
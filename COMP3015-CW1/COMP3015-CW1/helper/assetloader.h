@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct GLFWwindow;
+
+// Runs asset loads on a worker thread with its own GL context, shared
+// with the main window, so files are read, decoded and uploaded while the
+// render thread keeps drawing.
+//
+// Each job is two halves. work() runs on the worker and may create shared
+// objects (buffers, textures, programs); a fence is inserted after it.
+// ready() runs on the render thread from poll() once that fence has
+// signalled, and is where per-context state such as VAOs is built and the
+// results are swapped in. Jobs complete in the order they were queued.
+class AssetLoader {
+public:
+    typedef std::function<bool()> Work;
+    typedef std::function<void(bool ok)> Ready;
+
+    // Creates a hidden window sharing mainWindow's context. Must be called
+    // on the main thread, like every other GLFW window call.
+    explicit AssetLoader(GLFWwindow *mainWindow);
+
+    // Finishes the job in progress, drops the rest and destroys the
+    // worker's context. Must run before glfwTerminate.
+    ~AssetLoader();
+
+    // Make it non-copyable.
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader & operator=(const AssetLoader &) = delete;
+
+    void enqueue(Work work, Ready ready);
+
+    // Hands finished jobs to their ready() callbacks without waiting on
+    // the GPU; call once per frame on the render thread.
+    void poll();
+
+    // Jobs queued or finished but not yet handed over.
+    size_t pending();
+
+private:
+    struct Job {
+        Work work;
+        Ready ready;
+        bool ok = false;
+        GLsync fence = nullptr;
+    };
+
+    GLFWwindow *context;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> queued;
+    std::deque<Job> finished;
+    size_t running = 0;     // 1 while the worker is inside work()
+    bool stopping = false;
+
+    void run();
+};
@@ -0,0 +1,414 @@
+#include "bcencode.h"
+
+#include "glutils.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define BC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// One 4x4 block, channel-major so four texels load as one SSE vector
+struct Block {
+    float c[4][16];
+};
+
+void loadBlock(const unsigned char *rgba, int width, int height, int bx, int by, Block &b) {
+    for (int y = 0; y < 4; ++y) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            const unsigned char *p = rgba + (size_t(sy) * width + sx) * 4;
+            for (int ch = 0; ch < 4; ++ch) b.c[ch][y * 4 + x] = p[ch];
+        }
+    }
+}
+
+// Picks the nearest palette entry for each texel under per-channel
+// weights and returns the summed squared error. Ties keep the lower index.
+float fitIndices(const Block &b, const float (*palette)[4], int count, const float *weight, uint8_t *indices) {
+    float total = 0.0f;
+#ifdef BC_SSE2
+    for (int i = 0; i < 16; i += 4) {
+        __m128 ch[4];
+        for (int c = 0; c < 4; ++c) ch[c] = _mm_loadu_ps(&b.c[c][i]);
+
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int k = 0; k < count; ++k) {
+            __m128 d = _mm_setzero_ps();
+            for (int c = 0; c < 4; ++c) {
+                if (weight[c] == 0.0f) continue;
+                __m128 diff = _mm_sub_ps(ch[c], _mm_set1_ps(palette[k][c]));
+                d = _mm_add_ps(d, _mm_mul_ps(_mm_mul_ps(diff, diff), _mm_set1_ps(weight[c])));
+            }
+            __m128i less = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(d, best);
+            bestIndex = _mm_or_si128(_mm_andnot_si128(less, bestIndex), _mm_and_si128(less, _mm_set1_epi32(k)));
+        }
+
+        int32_t idx[4];
+        float err[4];
+        _mm_storeu_si128((__m128i *)idx, bestIndex);
+        _mm_storeu_ps(err, best);
+        for (int j = 0; j < 4; ++j) {
+            indices[i + j] = (uint8_t)idx[j];
+            total += err[j];
+        }
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        float best = FLT_MAX;
+        int bestIndex = 0;
+        for (int k = 0; k < count; ++k) {
+            float d = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                float diff = b.c[c][i] - palette[k][c];
+                d += diff * diff * weight[c];
+            }
+            if (d < best) {
+                best = d;
+                bestIndex = k;
+            }
+        }
+        indices[i] = (uint8_t)bestIndex;
+        total += best;
+    }
+#endif
+    return total;
+}
+
+// Mean and dominant direction of the weighted channels (power iteration
+// on the covariance). The axis is zero for a flat block.
+void principalAxis(const Block &b, const float *weight, float mean[4], float axis[4]) {
+    for (int c = 0; c < 4; ++c) {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; ++i) mean[c] += b.c[c][i];
+        mean[c] /= 16.0f;
+    }
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < 4; ++c) d[c] = weight[c] > 0.0f ? b.c[c][i] - mean[c] : 0.0f;
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c) cov[r][c] += d[r] * d[c];
+    }
+
+    float v[4];
+    for (int c = 0; c < 4; ++c) v[c] = weight[c] > 0.0f ? 1.0f : 0.0f;
+    for (int iter = 0; iter < 8; ++iter) {
+        float n[4] = {};
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c) n[r] += cov[r][c] * v[c];
+        float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] + n[3] * n[3]);
+        if (len < 1e-6f) {
+            for (int c = 0; c < 4; ++c) axis[c] = 0.0f;
+            return;
+        }
+        for (int c = 0; c < 4; ++c) v[c] = n[c] / len;
+    }
+    for (int c = 0; c < 4; ++c) axis[c] = v[c];
+}
+
+// Endpoints at the extremes of the block's projection onto the axis
+void axisEndpoints(const Block &b, const float mean[4], const float axis[4], float lo[4], float hi[4]) {
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < 4; ++c) t += (b.c[c][i] - mean[c]) * axis[c];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+    for (int c = 0; c < 4; ++c) {
+        lo[c] = std::min(std::max(mean[c] + axis[c] * tmin, 0.0f), 255.0f);
+        hi[c] = std::min(std::max(mean[c] + axis[c] * tmax, 0.0f), 255.0f);
+    }
+}
+
+// Endpoints minimising the squared error for fixed indices, where texel i
+// is firstWeight[indices[i]] of e0 plus the rest of e1
+bool leastSquares(const Block &b, const uint8_t *indices, const float *firstWeight, float e0[4], float e1[4]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float x[4] = {}, y[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float w = firstWeight[indices[i]], v = 1.0f - w;
+        aa += w * w;
+        ab += w * v;
+        bb += v * v;
+        for (int c = 0; c < 4; ++c) {
+            x[c] += w * b.c[c][i];
+            y[c] += v * b.c[c][i];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) return false;
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = std::min(std::max((bb * x[c] - ab * y[c]) / det, 0.0f), 255.0f);
+        e1[c] = std::min(std::max((aa * y[c] - ab * x[c]) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+// --- BC1 colour ---------------------------------------------------------
+
+const float RGB_WEIGHT[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+const float BC1_FIRST_WEIGHT[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+uint16_t to565(const float c[4]) {
+    int r = (int)(c[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(c[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void from565(uint16_t v, float c[4]) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = float((r << 3) | (r >> 2));
+    c[1] = float((g << 2) | (g >> 4));
+    c[2] = float((b << 3) | (b >> 2));
+    c[3] = 0.0f;
+}
+
+float fitBC1(const Block &b, uint16_t c0, uint16_t c1, uint8_t *indices) {
+    float palette[4][4];
+    from565(c0, palette[0]);
+    from565(c1, palette[1]);
+    for (int c = 0; c < 4; ++c) {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    return fitIndices(b, palette, 4, RGB_WEIGHT, indices);
+}
+
+void encodeColor(const Block &b, unsigned char *dst) {
+    float mean[4], axis[4], lo[4], hi[4];
+    principalAxis(b, RGB_WEIGHT, mean, axis);
+    axisEndpoints(b, mean, axis, lo, hi);
+
+    uint16_t c0 = to565(hi), c1 = to565(lo);
+    uint8_t indices[16];
+    float err = fitBC1(b, c0, c1, indices);
+
+    for (int iter = 0; iter < 2 && err > 0.0f; ++iter) {
+        float e0[4], e1[4];
+        uint8_t trial[16];
+        if (!leastSquares(b, indices, BC1_FIRST_WEIGHT, e0, e1)) break;
+        uint16_t t0 = to565(e0), t1 = to565(e1);
+        float terr = fitBC1(b, t0, t1, trial);
+        if (terr >= err) break;
+        c0 = t0;
+        c1 = t1;
+        err = terr;
+        memcpy(indices, trial, 16);
+    }
+
+    // c0 > c1 selects four-colour mode; equal endpoints need index 0 everywhere
+    if (c0 < c1) {
+        std::swap(c0, c1);
+        for (uint8_t &i : indices) i ^= 1;
+    }
+    if (c0 == c1) memset(indices, 0, 16);
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= uint32_t(indices[i]) << (i * 2);
+    dst[0] = uint8_t(c0);
+    dst[1] = uint8_t(c0 >> 8);
+    dst[2] = uint8_t(c1);
+    dst[3] = uint8_t(c1 >> 8);
+    memcpy(dst + 4, &bits, 4);
+}
+
+// --- BC3 alpha ----------------------------------------------------------
+
+void encodeAlpha(const Block &b, unsigned char *dst) {
+    static const float ALPHA_WEIGHT[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    float amin = 255.0f, amax = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        amin = std::min(amin, b.c[3][i]);
+        amax = std::max(amax, b.c[3][i]);
+    }
+    int a0 = (int)(amax + 0.5f), a1 = (int)(amin + 0.5f);
+    memset(dst, 0, 8);
+    dst[0] = uint8_t(a0);
+    dst[1] = uint8_t(a1);
+    if (a0 == a1) return;
+
+    // a0 > a1: six interpolated values between the endpoints
+    float palette[8][4] = {};
+    palette[0][3] = float(a0);
+    palette[1][3] = float(a1);
+    for (int i = 2; i < 8; ++i) palette[i][3] = float((8 - i) * a0 + (i - 1) * a1) / 7.0f;
+
+    uint8_t indices[16];
+    fitIndices(b, palette, 8, ALPHA_WEIGHT, indices);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= uint64_t(indices[i]) << (i * 3);
+    for (int i = 0; i < 6; ++i) dst[2 + i] = uint8_t(bits >> (i * 8));
+}
+
+// --- BC7 mode 6 ---------------------------------------------------------
+
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+const float BC7_FIRST_WEIGHT[16] = {
+    64 / 64.0f, 60 / 64.0f, 55 / 64.0f, 51 / 64.0f, 47 / 64.0f, 43 / 64.0f, 38 / 64.0f, 34 / 64.0f,
+    30 / 64.0f, 26 / 64.0f, 21 / 64.0f, 17 / 64.0f, 13 / 64.0f, 9 / 64.0f, 4 / 64.0f, 0 / 64.0f
+};
+const float RGBA_WEIGHT[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+// 7-bit endpoint plus shared p-bit, choosing the p-bit that lands closer
+void quantizeBC7(const float e[4], int q[4], int &p) {
+    float bestErr = FLT_MAX;
+    for (int pbit = 0; pbit < 2; ++pbit) {
+        int trial[4];
+        float err = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            trial[c] = std::min(std::max((int)std::floor((e[c] - pbit) / 2.0f + 0.5f), 0), 127);
+            float d = float(trial[c] * 2 + pbit) - e[c];
+            err += d * d;
+        }
+        if (err < bestErr) {
+            bestErr = err;
+            p = pbit;
+            memcpy(q, trial, sizeof(trial));
+        }
+    }
+}
+
+float fitBC7(const Block &b, const int q0[4], int p0, const int q1[4], int p1, uint8_t *indices) {
+    float palette[16][4];
+    for (int c = 0; c < 4; ++c) {
+        int v0 = q0[c] * 2 + p0, v1 = q1[c] * 2 + p1;
+        for (int k = 0; k < 16; ++k)
+            palette[k][c] = float(((64 - BC7_WEIGHTS[k]) * v0 + BC7_WEIGHTS[k] * v1 + 32) >> 6);
+    }
+    return fitIndices(b, palette, 16, RGBA_WEIGHT, indices);
+}
+
+struct BitWriter {
+    uint64_t word[2] = { 0, 0 };
+    int pos = 0;
+
+    void put(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++pos)
+            if (value & (1u << i)) word[pos >> 6] |= uint64_t(1) << (pos & 63);
+    }
+};
+
+void encodeBC7(const Block &b, unsigned char *dst) {
+    float mean[4], axis[4], lo[4], hi[4];
+    principalAxis(b, RGBA_WEIGHT, mean, axis);
+    axisEndpoints(b, mean, axis, lo, hi);
+
+    int q0[4], q1[4], p0 = 0, p1 = 0;
+    quantizeBC7(lo, q0, p0);
+    quantizeBC7(hi, q1, p1);
+    uint8_t indices[16];
+    float err = fitBC7(b, q0, p0, q1, p1, indices);
+
+    for (int iter = 0; iter < 2 && err > 0.0f; ++iter) {
+        float e0[4], e1[4];
+        if (!leastSquares(b, indices, BC7_FIRST_WEIGHT, e0, e1)) break;
+        int t0[4], t1[4], tp0 = 0, tp1 = 0;
+        quantizeBC7(e0, t0, tp0);
+        quantizeBC7(e1, t1, tp1);
+        uint8_t trial[16];
+        float terr = fitBC7(b, t0, tp0, t1, tp1, trial);
+        if (terr >= err) break;
+        memcpy(q0, t0, sizeof(q0));
+        memcpy(q1, t1, sizeof(q1));
+        p0 = tp0;
+        p1 = tp1;
+        err = terr;
+        memcpy(indices, trial, 16);
+    }
+
+    // The first index is stored with its top bit implied zero
+    if (indices[0] & 8) {
+        for (int c = 0; c < 4; ++c) std::swap(q0[c], q1[c]);
+        std::swap(p0, p1);
+        for (uint8_t &i : indices) i = uint8_t(15 - i);
+    }
+
+    BitWriter w;
+    w.put(1u << 6, 7);     // mode 6
+    for (int c = 0; c < 4; ++c) {
+        w.put(q0[c], 7);
+        w.put(q1[c], 7);
+    }
+    w.put(p0, 1);
+    w.put(p1, 1);
+    w.put(indices[0], 3);
+    for (int i = 1; i < 16; ++i) w.put(indices[i], 4);
+    memcpy(dst, w.word, 16);
+}
+
+} // namespace
+
+namespace BC {
+
+size_t blockBytes(Format format) {
+    return format == BC1 ? 8 : 16;
+}
+
+size_t levelSize(Format format, int width, int height) {
+    return size_t((width + 3) / 4) * size_t((height + 3) / 4) * blockBytes(format);
+}
+
+GLenum glFormat(Format format) {
+    switch (format) {
+    case BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:  return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+}
+
+const char *name(Format format) {
+    switch (format) {
+    case BC1: return "BC1";
+    case BC3: return "BC3";
+    default:  return "BC7";
+    }
+}
+
+bool supported(Format format) {
+    return format == BC7 || GLUtils::hasExtension("GL_EXT_texture_compression_s3tc");
+}
+
+void encode(const unsigned char *rgba, int width, int height, Format format,
+            std::vector<unsigned char> &out) {
+    const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+    const size_t stride = blockBytes(format);
+    out.resize(size_t(bw) * bh * stride);
+
+    Block block;
+    unsigned char *dst = out.data();
+    for (int by = 0; by < bh; ++by) {
+        for (int bx = 0; bx < bw; ++bx, dst += stride) {
+            loadBlock(rgba, width, height, bx, by, block);
+            switch (format) {
+            case BC1:
+                encodeColor(block, dst);
+                break;
+            case BC3:
+                encodeAlpha(block, dst);
+                encodeColor(block, dst + 8);
+                break;
+            default:
+                encodeBC7(block, dst);
+                break;
+            }
+        }
+    }
+}
+
+} // namespace BC
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// S3TC enums; the extension is not in the generated loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Block compression of RGBA8 images into 4x4 blocks the GPU samples
+// directly.
+//   BC1: RGB, 4 bits per texel (8x smaller than RGBA8)
+//   BC3: BC1 colour plus an interpolated alpha block, 8 bits per texel
+//   BC7: RGBA at 8 bits per texel; only mode 6 (one subset, 7-bit
+//        endpoints with a p-bit, 16 weights) is produced
+// Endpoints come from the principal axis of the block and are refined by
+// least squares; index selection uses SSE2 where available.
+namespace BC
+{
+    enum Format { BC1, BC3, BC7 };
+
+    // Bytes per 4x4 block: 8 for BC1, 16 for BC3 and BC7.
+    size_t blockBytes(Format format);
+    size_t levelSize(Format format, int width, int height);
+    GLenum glFormat(Format format);
+    const char *name(Format format);
+
+    // BC1 and BC3 need EXT_texture_compression_s3tc; BC7 is core since 4.2.
+    // Needs a current context.
+    bool supported(Format format);
+
+    // Compresses an RGBA8 image. Blocks past the right or bottom edge
+    // repeat the last column or row.
+    void encode(const unsigned char *rgba, int width, int height, Format format,
+                std::vector<unsigned char> &out);
+}
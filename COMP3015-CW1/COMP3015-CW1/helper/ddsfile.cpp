@@ -0,0 +1,230 @@
+#include "ddsfile.h"
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace {
+
+inline uint32_t fourCC(char a, char b, char c, char d) {
+    return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+const uint32_t DDS_MAGIC = fourCC('D', 'D', 'S', ' ');
+const uint32_t SOURCE_TAG = fourCC('C', 'W', 'B', 'C');
+
+// Header flags
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDSD_PITCH = 0x8;
+const uint32_t DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+// DXGI_FORMAT_BC7_UNORM and D3D10_RESOURCE_DIMENSION_TEXTURE2D
+const uint32_t DXGI_BC7_UNORM = 98;
+const uint32_t DIMENSION_TEXTURE2D = 3;
+
+struct PixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t mask[4];
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];     // [0] tag, [1] version, [2..3] source hash
+    PixelFormat pixelFormat;
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+struct HeaderDx10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static_assert(sizeof(Header) == 128, "DDS header is 4 + 124 bytes");
+static_assert(sizeof(HeaderDx10) == 20, "DX10 header is 20 bytes");
+
+// Bytes in level i of a chain, blocks or RGBA8
+size_t levelBytes(bool compressed, BC::Format format, int width, int height, int i) {
+    int lw = std::max(1, width >> i), lh = std::max(1, height >> i);
+    return compressed ? BC::levelSize(format, lw, lh) : size_t(lw) * lh * 4;
+}
+
+// The fields shared by every file this writes; the caller sets the pixel format
+Header makeHeader(uint64_t sourceHash, int width, int height, size_t levelCount) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DDS_MAGIC;
+    header.size = 124;
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+    header.height = (uint32_t)height;
+    header.width = (uint32_t)width;
+    header.mipMapCount = (uint32_t)levelCount;
+    header.reserved1[0] = SOURCE_TAG;
+    header.reserved1[1] = DdsFile::VERSION;
+    header.reserved1[2] = uint32_t(sourceHash);
+    header.reserved1[3] = uint32_t(sourceHash >> 32);
+    header.pixelFormat.size = 32;
+    header.caps[0] = DDSCAPS_TEXTURE | (levelCount > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+    return header;
+}
+
+bool writeFile(const char *fileName, const Header &header, const HeaderDx10 *dx10,
+               const std::vector<std::vector<unsigned char>> &levels) {
+    // Write to a temporary name first so a crash never leaves a half-written file
+    std::string tmpName = std::string(fileName) + ".tmp";
+    {
+        std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write((const char *)&header, sizeof(header));
+        if (dx10) out.write((const char *)dx10, sizeof(*dx10));
+        for (const std::vector<unsigned char> &level : levels)
+            out.write((const char *)level.data(), level.size());
+        if (!out) return false;
+    }
+
+    std::remove(fileName);
+    return std::rename(tmpName.c_str(), fileName) == 0;
+}
+
+} // namespace
+
+bool DdsFile::hashSource(const char *fileName, uint64_t &outHash) {
+    MappedFile f;
+    if (!f.open(fileName)) return false;
+    outHash = Hash::combine(VERSION, Hash::bytes(f.data(), f.size(), f.size()));
+    return true;
+}
+
+bool DdsFile::write(const char *fileName, uint64_t sourceHash, BC::Format format,
+                    int width, int height, const std::vector<std::vector<unsigned char>> &levels) {
+    for (size_t i = 0; i < levels.size(); ++i) {
+        if (levels[i].size() != levelBytes(true, format, width, height, (int)i)) return false;
+    }
+
+    Header header = makeHeader(sourceHash, width, height, levels.size());
+    header.flags |= DDSD_LINEARSIZE;
+    header.pitchOrLinearSize = (uint32_t)BC::levelSize(format, width, height);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = format == BC::BC1 ? fourCC('D', 'X', 'T', '1')
+                              : format == BC::BC3 ? fourCC('D', 'X', 'T', '5')
+                              : fourCC('D', 'X', '1', '0');
+
+    HeaderDx10 dx10 = { DXGI_BC7_UNORM, DIMENSION_TEXTURE2D, 0, 1, 0 };
+    return writeFile(fileName, header, format == BC::BC7 ? &dx10 : nullptr, levels);
+}
+
+bool DdsFile::writeRGBA8(const char *fileName, uint64_t sourceHash,
+                         int width, int height, const std::vector<std::vector<unsigned char>> &levels) {
+    for (size_t i = 0; i < levels.size(); ++i) {
+        if (levels[i].size() != levelBytes(false, BC::BC1, width, height, (int)i)) return false;
+    }
+
+    // Bytes R, G, B, A in memory order, as GL_RGBA/GL_UNSIGNED_BYTE reads them
+    Header header = makeHeader(sourceHash, width, height, levels.size());
+    header.flags |= DDSD_PITCH;
+    header.pitchOrLinearSize = (uint32_t)width * 4;
+    header.pixelFormat.flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+    header.pixelFormat.rgbBitCount = 32;
+    header.pixelFormat.mask[0] = 0x000000ff;
+    header.pixelFormat.mask[1] = 0x0000ff00;
+    header.pixelFormat.mask[2] = 0x00ff0000;
+    header.pixelFormat.mask[3] = 0xff000000;
+    return writeFile(fileName, header, nullptr, levels);
+}
+
+bool DdsFile::open(const char *fileName, uint64_t sourceHash) {
+    close();
+    if (!file.open(fileName)) return false;
+
+    const char *base = file.data();
+    const size_t size = file.size();
+
+    Header header;
+    if (size < sizeof(header)) { close(); return false; }
+    memcpy(&header, base, sizeof(header));
+
+    uint64_t storedHash = uint64_t(header.reserved1[2]) | (uint64_t(header.reserved1[3]) << 32);
+    if (header.magic != DDS_MAGIC || header.size != 124 ||
+        header.reserved1[0] != SOURCE_TAG || header.reserved1[1] != VERSION || storedHash != sourceHash ||
+        header.width == 0 || header.height == 0) {
+        close();
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    compressed = (header.pixelFormat.flags & DDPF_FOURCC) != 0;
+    if (!compressed) {
+        const PixelFormat &pf = header.pixelFormat;
+        if (!(pf.flags & DDPF_RGB) || !(pf.flags & DDPF_ALPHAPIXELS) || pf.rgbBitCount != 32 ||
+            pf.mask[0] != 0x000000ff || pf.mask[1] != 0x0000ff00 || pf.mask[2] != 0x00ff0000 || pf.mask[3] != 0xff000000) {
+            close();
+            return false;
+        }
+    }
+    else if (header.pixelFormat.fourCC == fourCC('D', 'X', 'T', '1')) {
+        fmt = BC::BC1;
+    }
+    else if (header.pixelFormat.fourCC == fourCC('D', 'X', 'T', '5')) {
+        fmt = BC::BC3;
+    }
+    else if (header.pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+        HeaderDx10 dx10;
+        if (size < offset + sizeof(dx10)) { close(); return false; }
+        memcpy(&dx10, base + offset, sizeof(dx10));
+        if (dx10.dxgiFormat != DXGI_BC7_UNORM || dx10.arraySize != 1) { close(); return false; }
+        fmt = BC::BC7;
+        offset += sizeof(dx10);
+    }
+    else {
+        close();
+        return false;
+    }
+
+    w = (int)header.width;
+    h = (int)header.height;
+    uint32_t levels = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+    if (levels > 32) { close(); return false; }
+
+    for (uint32_t i = 0; i < levels; ++i) {
+        size_t bytes = levelBytes(compressed, fmt, w, h, (int)i);
+        if (offset + bytes > size) { close(); return false; }
+        levelOffsets.push_back(offset);
+        offset += bytes;
+    }
+    return true;
+}
+
+void DdsFile::close() {
+    levelOffsets.clear();
+    compressed = true;
+    fmt = BC::BC1;
+    w = h = 0;
+    file.close();
+}
+
+const unsigned char *DdsFile::level(int i) const {
+    return (const unsigned char *)file.data() + levelOffsets[i];
+}
+
+size_t DdsFile::levelSize(int i) const {
+    return levelBytes(compressed, fmt, w, h, i);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "bcencode.h"
+#include "mappedfile.h"
+
+#include <cstdint>
+#include <vector>
+
+// Textures with their mip chain in a DDS file, readable by the usual
+// texture tools. BC1 and BC3 use the DXT1/DXT5 FourCCs, BC7 the DX10
+// extension header, and uncompressed chains are 32-bit RGBA.
+//
+// Four of the header's reserved words hold a tag and the hash of the
+// source image, so a copy made from a different source is rejected and
+// rebuilt. The file is memory-mapped on load and the levels go straight
+// to glCompressedTextureSubImage2D or glTextureSubImage2D.
+class DdsFile {
+public:
+    static const uint32_t VERSION = 1;
+
+    // Hash of the image the blocks are made from.
+    static bool hashSource(const char *fileName, uint64_t &outHash);
+
+    // levels[0] is the full-size image.
+    static bool write(const char *fileName, uint64_t sourceHash, BC::Format format,
+                      int width, int height, const std::vector<std::vector<unsigned char>> &levels);
+    static bool writeRGBA8(const char *fileName, uint64_t sourceHash,
+                           int width, int height, const std::vector<std::vector<unsigned char>> &levels);
+
+    DdsFile() = default;
+
+    // Maps and validates the file. Returns false on a missing, stale or
+    // truncated file, or one in a format this loader doesn't handle.
+    bool open(const char *fileName, uint64_t sourceHash);
+    void close();
+
+    // format() is only meaningful for compressed files
+    bool isCompressed() const { return compressed; }
+    BC::Format format() const { return fmt; }
+    int width() const { return w; }
+    int height() const { return h; }
+    int levelCount() const { return (int)levelOffsets.size(); }
+
+    // Blocks of one level; valid until close().
+    const unsigned char *level(int i) const;
+    size_t levelSize(int i) const;
+
+private:
+    MappedFile file;
+    bool compressed = true;
+    BC::Format fmt = BC::BC1;
+    int w = 0;
+    int h = 0;
+    std::vector<size_t> levelOffsets;
+};
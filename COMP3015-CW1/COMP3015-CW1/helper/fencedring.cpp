@@ -0,0 +1,81 @@
+#include "fencedring.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+size_t alignUp(size_t n, size_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+FencedRing::FencedRing(size_t segmentBytes, Policy policy, const char *label)
+    : segmentSize(segmentBytes), policy(policy), label(label) {}
+
+FencedRing::~FencedRing() {
+    if (buffer == 0) return;
+    for (GLsync &fence : fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    glUnmapNamedBuffer(buffer);
+    glDeleteBuffers(1, &buffer);
+}
+
+void FencedRing::create(size_t alignment) {
+    this->alignment = std::max<size_t>(1, alignment);
+    segmentSize = alignUp(segmentSize, this->alignment);
+
+    // Persistent and coherent: written with memcpy, never unmapped while in use
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, segmentSize * SEGMENTS, nullptr, flags);
+    mapped = (unsigned char *)glMapNamedBufferRange(buffer, 0, segmentSize * SEGMENTS, flags);
+    if (!mapped) {
+        std::cerr << "Unable to map the " << label << "." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool FencedRing::ready() {
+    if (checked) return fences[segment] == nullptr;
+    checked = true;
+
+    // The GPU may still be reading what was written here SEGMENTS frames ago
+    GLsync &fence = fences[segment];
+    if (!fence) return true;
+    if (policy == Wait) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    }
+    else if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+    return true;
+}
+
+size_t FencedRing::room() const {
+    return segmentSize - std::min(segmentSize, alignUp(usedBytes, alignment));
+}
+
+unsigned char *FencedRing::reserve(size_t bytes, size_t &offset) {
+    if (!ready()) return nullptr;
+    size_t start = alignUp(usedBytes, alignment);
+    if (start + bytes > segmentSize) return nullptr;
+    usedBytes = start + bytes;
+    offset = size_t(segment) * segmentSize + start;
+    return mapped + offset;
+}
+
+void FencedRing::endFrame() {
+    // A segment nothing went into is still free next frame
+    if (usedBytes > 0) {
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        segment = (segment + 1) % SEGMENTS;
+        usedBytes = 0;
+    }
+    checked = false;
+}
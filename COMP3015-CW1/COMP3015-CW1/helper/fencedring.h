@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// A persistently mapped, coherent buffer split in one segment per frame
+// in flight. Each frame writes its segment with memcpy and endFrame()
+// fences it, so it is written again only once the GPU has finished
+// reading it SEGMENTS frames later.
+//
+// What happens when that fence hasn't signalled is up to the owner: Wait
+// blocks until it does, for data a frame can't go without; Skip leaves
+// the segment unwritten this frame, for work that can be put off.
+class FencedRing {
+public:
+    enum Policy { Wait, Skip };
+
+    static const int SEGMENTS = 3;
+
+    // label names the buffer in the error if it can't be mapped.
+    FencedRing(size_t segmentBytes, Policy policy, const char *label);
+    ~FencedRing();
+
+    // Make it non-copyable.
+    FencedRing(const FencedRing &) = delete;
+    FencedRing & operator=(const FencedRing &) = delete;
+
+    // Makes the buffer, with the segment size rounded up to alignment,
+    // which reserve() also starts every allocation at. Needs a context.
+    void create(size_t alignment);
+    bool created() const { return buffer != 0; }
+
+    // Whether this frame's segment may be written. Wait policy always
+    // returns true, having waited if it had to; Skip asks the fence once
+    // a frame.
+    bool ready();
+
+    // Room for bytes in this frame's segment, or nullptr when it is full or
+    // not ready. offset is from the start of the buffer.
+    unsigned char *reserve(size_t bytes, size_t &offset);
+
+    // Fences what this frame wrote, if anything, and moves on a segment.
+    void endFrame();
+
+    GLuint name() const { return buffer; }
+    size_t segmentBytes() const { return segmentSize; }
+    size_t used() const { return usedBytes; }
+    size_t room() const;
+
+private:
+    size_t segmentSize;
+    size_t alignment = 1;
+    Policy policy;
+    const char *label;
+
+    GLuint buffer = 0;
+    unsigned char *mapped = nullptr;
+    GLsync fences[SEGMENTS] = {};
+    int segment = 0;
+    size_t usedBytes = 0;       // of the current segment, this frame
+    bool checked = false;       // ready() has asked this frame's fence
+};
@@ -1,8 +1,16 @@
 #include "glslprogram.h"
 
 #include "glutils.h"
+#include "hash.h"
 
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iostream>
 
 using std::ifstream;
 using std::ios;
@@ -30,11 +38,78 @@ namespace GLSLShaderInfo {
 		{"_frag.glsl", GLSLShader::FRAGMENT},
 		{".frag.glsl", GLSLShader::FRAGMENT},
 		{".cs",   GLSLShader::COMPUTE},
+		{".comp", GLSLShader::COMPUTE},
 		{ ".cs.glsl",   GLSLShader::COMPUTE }
 	};
 }
 
-GLSLProgram::GLSLProgram() : handle(0), linked(false) {}
+namespace {
+
+const char BINARY_MAGIC[4] = { 'G', 'P', 'R', 'B' };
+const uint32_t BINARY_VERSION = 1;
+
+struct BinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t payloadHash;   // hash of the program binary that follows
+    uint32_t format;
+    uint32_t length;
+};
+
+static_assert(sizeof(BinaryHeader) == 32, "program binary header layout changed");
+
+bool parallelCompile = false;
+
+bool isSampler(GLenum type) {
+    switch (type) {
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_2D:
+        case GL_INT_SAMPLER_2D_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Samplers and bools are set as ints
+bool typeMatches(GLenum declared, GLenum type) {
+    return declared == type || (type == GL_INT && (declared == GL_BOOL || isSampler(declared)));
+}
+
+// The specialization constant ids a SPIR-V module declares: its
+// OpDecorate <id> SpecId <n> instructions
+std::vector<GLuint> specIds(const std::string &module) {
+    const uint32_t OP_DECORATE = 71;
+    const uint32_t SPEC_ID = 1;
+    std::vector<GLuint> ids;
+    std::vector<uint32_t> words(module.size() / 4);
+    memcpy(words.data(), module.data(), words.size() * 4);
+    for (size_t at = 5; at < words.size(); ) {
+        uint32_t count = words[at] >> 16;
+        if (count == 0 || at + count > words.size()) break;
+        if ((words[at] & 0xFFFF) == OP_DECORATE && count == 4 && words[at + 2] == SPEC_ID) ids.push_back(words[at + 3]);
+        at += count;
+    }
+    return ids;
+}
+
+uint64_t hashString(uint64_t h, const char *str) {
+    if (!str) str = "";
+    return Hash::combine(h, Hash::bytes(str, strlen(str)));
+}
+
+} // namespace
+
+GLSLProgram::GLSLProgram() : handle(0), linked(false), linking(false), fromBinary(false), key(0) {}
 
 GLSLProgram::~GLSLProgram() {
     if (handle == 0) return;
@@ -132,47 +207,305 @@ void GLSLProgram::compileShader(const string &source,
         }
     }
 
-    GLuint shaderHandle = glCreateShader(type);
+    PendingShader shader;
+    shader.type = type;
+    shader.source = withDefines(source);
+    if (fileName) shader.fileName = fileName;
+    shader.spirv = false;
+    pending.push_back(shader);
+}
 
-    const char *c_code = source.c_str();
-    glShaderSource(shaderHandle, 1, &c_code, NULL);
+void GLSLProgram::compileSpirv(const char *fileName) {
+    // The stage is the GLSL file's: basic_uniform.frag.spv is a fragment shader
+    string glslName(fileName);
+    if (glslName.size() > 4 && glslName.compare(glslName.size() - 4, 4, ".spv") == 0) {
+        glslName.resize(glslName.size() - 4);
+    }
+    string ext = getExtension(glslName.c_str());
+    auto it = GLSLShaderInfo::extensions.find(ext);
+    if (it == GLSLShaderInfo::extensions.end()) {
+        throw GLSLProgramException("Unrecognized extension: " + ext);
+    }
 
-    // Compile the shader
-    glCompileShader(shaderHandle);
+    if (!fileExists(fileName)) {
+        throw GLSLProgramException(string("Shader: ") + fileName + " not found.");
+    }
 
-    // Check for errors
-    int result;
-    glGetShaderiv(shaderHandle, GL_COMPILE_STATUS, &result);
-    if (GL_FALSE == result) {
-        // Compile failed, get log
-		std::string msg;
-		if (fileName) {
-			msg = string(fileName) + ": shader compliation failed\n";
-		}
-		else {
-			msg = "Shader compilation failed.\n";
-		}
+    if (handle <= 0) {
+        handle = glCreateProgram();
+        if (handle == 0) {
+            throw GLSLProgramException("Unable to create shader program.");
+        }
+    }
 
-        int length = 0;
-        glGetShaderiv(shaderHandle, GL_INFO_LOG_LENGTH, &length);
-        if (length > 0) {
-            std::string log(length, ' ');
-            int written = 0;
-            glGetShaderInfoLog(shaderHandle, length, &written, &log[0]);
-			msg += log;
+    ifstream inFile(fileName, ios::in | ios::binary);
+    if (!inFile) {
+        throw GLSLProgramException(string("Unable to open: ") + fileName);
+    }
+    std::stringstream code;
+    code << inFile.rdbuf();
+    inFile.close();
+
+    // A whole number of words, starting with the magic number
+    string words = code.str();
+    uint32_t magic = 0;
+    if (words.size() >= 20) memcpy(&magic, words.data(), sizeof(magic));
+    if (words.size() % 4 != 0 || magic != 0x07230203) {
+        throw GLSLProgramException(string("Not a SPIR-V module: ") + fileName);
+    }
+
+    PendingShader shader;
+    shader.type = it->second;
+    shader.source = words;
+    shader.fileName = fileName;
+    shader.spirv = true;
+    pending.push_back(shader);
+}
+
+void GLSLProgram::specialize(GLuint constantId, GLuint value) {
+    constants.push_back(std::make_pair(constantId, value));
+}
+
+bool GLSLProgram::spirvSupported() {
+    // Some drivers leave SPIR-V out of GL_SHADER_BINARY_FORMATS, so go by the extension
+    return GLUtils::hasExtension("GL_ARB_gl_spirv");
+}
+
+void GLSLProgram::define(const string &name, const string &value) {
+    defines.push_back(std::make_pair(name, value));
+}
+
+string GLSLProgram::withDefines(const string &source) const {
+    if (defines.empty()) return source;
+
+    // #version has to come first; anything else may follow it
+    size_t at = 0;
+    int line = 1;
+    size_t version = source.find("#version");
+    if (version != string::npos) {
+        size_t end = source.find('\n', version);
+        at = end == string::npos ? source.size() : end + 1;
+        line += (int)std::count(source.begin(), source.begin() + at, '\n');
+    }
+
+    string block;
+    if (at > 0 && source[at - 1] != '\n') block += '\n';
+    for (const auto &d : defines) block += "#define " + d.first + " " + d.second + "\n";
+    block += "#line " + std::to_string(line) + "\n";
+    return source.substr(0, at) + block + source.substr(at);
+}
+
+void GLSLProgram::compilePending() {
+    // Status is only asked for in finishLink(); asking now would wait for the compile
+    for (const PendingShader &shader : pending) {
+        GLuint shaderHandle = glCreateShader(shader.type);
+
+        if (shader.spirv) {
+            // Only the constants the module has; naming any other is an error
+            std::vector<GLuint> declared = specIds(shader.source);
+            std::vector<GLuint> ids, values;
+            for (const auto &c : constants) {
+                if (std::find(declared.begin(), declared.end(), c.first) == declared.end()) continue;
+                ids.push_back(c.first);
+                values.push_back(c.second);
+            }
+
+            // Specializing stands in for compiling, and reports to the same log
+            glShaderBinary(1, &shaderHandle, GL_SHADER_BINARY_FORMAT_SPIR_V, shader.source.data(),
+                           (GLsizei)shader.source.size());
+            glSpecializeShader(shaderHandle, "main", (GLuint)ids.size(), ids.data(), values.data());
+        }
+        else {
+            const char *c_code = shader.source.c_str();
+            glShaderSource(shaderHandle, 1, &c_code, NULL);
+            glCompileShader(shaderHandle);
         }
-        throw GLSLProgramException(msg);
-    } else {
-        // Compile succeeded, attach shader
         glAttachShader(handle, shaderHandle);
+        compiling.push_back(std::make_pair(shaderHandle, shader.fileName));
+    }
+}
+
+std::string GLSLProgram::binaryFileName() const {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0 || pending.empty()) return "";
+
+    // Beside the first shader, named for the shaders' stems and defines:
+    // shader/basic_uniform.vert + .frag -> shader/basic_uniform.progbin,
+    // or shader/basic_uniform+USE_FOG.progbin with USE_FOG defined, and
+    // shader/spv/basic_uniform+c2=1.progbin for SPIR-V with constant 2 = 1
+    std::string name;
+    std::string lastStem;
+    for (const PendingShader &shader : pending) {
+        if (shader.fileName.empty()) return "";
+        size_t slash = shader.fileName.find_last_of("/\\");
+        size_t start = slash == string::npos ? 0 : slash + 1;
+        size_t dot = shader.fileName.find('.', start);
+        std::string stem = shader.fileName.substr(start, dot == string::npos ? string::npos : dot - start);
+        if (stem == lastStem) continue;
+        if (name.empty()) name = shader.fileName.substr(0, start);
+        else name += '-';
+        name += stem;
+        lastStem = stem;
     }
+    for (const auto &d : defines) name += '+' + d.first;
+    for (const auto &c : constants) name += "+c" + std::to_string(c.first) + "=" + std::to_string(c.second);
+    return name + ".progbin";
+}
+
+uint64_t GLSLProgram::binaryKey() const {
+    // A binary is only good for the driver that made it
+    uint64_t h = BINARY_VERSION;
+    h = hashString(h, (const char *)glGetString(GL_VENDOR));
+    h = hashString(h, (const char *)glGetString(GL_RENDERER));
+    h = hashString(h, (const char *)glGetString(GL_VERSION));
+    for (const PendingShader &shader : pending) {
+        h = Hash::combine(h, uint64_t(shader.type));
+        h = Hash::combine(h, Hash::bytes(shader.source.data(), shader.source.size(), shader.source.size()));
+    }
+    for (const auto &c : constants) {
+        h = Hash::combine(h, (uint64_t(c.first) << 32) | c.second);
+    }
+    return h;
+}
+
+bool GLSLProgram::loadBinary(const string &fileName, uint64_t key) {
+    ifstream in(fileName, ios::in | ios::binary);
+    if (!in) return false;
+
+    BinaryHeader header;
+    if (!in.read((char *)&header, sizeof(header))) return false;
+    if (memcmp(header.magic, BINARY_MAGIC, 4) != 0 || header.version != BINARY_VERSION ||
+        header.key != key || header.length == 0) {
+        return false;
+    }
+
+    std::vector<char> binary(header.length);
+    if (!in.read(binary.data(), binary.size()) ||
+        Hash::bytes(binary.data(), binary.size()) != header.payloadHash) {
+        return false;
+    }
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    std::vector<GLint> formats(formatCount);
+    glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+    if (std::find(formats.begin(), formats.end(), GLint(header.format)) == formats.end()) return false;
+
+    // The driver may still refuse it, after an update that kept the version string
+    glProgramBinary(handle, header.format, binary.data(), (GLsizei)header.length);
+    GLint status = GL_FALSE;
+    glGetProgramiv(handle, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+void GLSLProgram::saveBinary(const string &fileName, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(handle, length, &length, &format, binary.data());
+    if (length <= 0) return;
+    binary.resize(length);
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, 4);
+    header.version = BINARY_VERSION;
+    header.key = key;
+    header.payloadHash = Hash::bytes(binary.data(), binary.size());
+    header.format = format;
+    header.length = (uint32_t)length;
+
+    // Write to a temporary name first so a crash never leaves a half-written binary
+    std::string tmpName = fileName + ".tmp";
+    {
+        std::ofstream out(tmpName, ios::binary | ios::trunc);
+        if (!out) return;
+        out.write((const char *)&header, sizeof(header));
+        out.write(binary.data(), binary.size());
+        if (!out) return;
+    }
+    std::remove(fileName.c_str());
+    std::rename(tmpName.c_str(), fileName.c_str());
+}
+
+bool GLSLProgram::enableParallelCompile() {
+    if (!GLUtils::hasExtension("GL_KHR_parallel_shader_compile")) return false;
+
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    if (!maxThreads) return false;
+
+    // 0xFFFFFFFF: an implementation-chosen number of threads
+    maxThreads(0xFFFFFFFF);
+    parallelCompile = true;
+    return true;
 }
 
 void GLSLProgram::link() {
-    if (linked) return;
+    linkAsync();
+    finishLink();
+}
+
+void GLSLProgram::linkAsync() {
+    if (linked || linking) return;
     if (handle <= 0) throw GLSLProgramException("Program has not been compiled.");
 
-    glLinkProgram(handle);
+    binaryName = binaryFileName();
+    key = binaryName.empty() ? 0 : binaryKey();
+    fromBinary = !binaryName.empty() && loadBinary(binaryName, key);
+    if (!fromBinary) {
+        compilePending();
+        if (!binaryName.empty()) glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(handle);
+    }
+    pending.clear();
+    linking = true;
+}
+
+bool GLSLProgram::isLinkDone() {
+    if (!linking || !parallelCompile) return true;
+    GLint done = GL_TRUE;
+    glGetProgramiv(handle, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+void GLSLProgram::finishLink() {
+    if (!linking) return;
+    linking = false;
+
+    // A failed compile explains the failed link, so it is reported instead
+    for (const auto &shader : compiling) {
+        int result;
+        glGetShaderiv(shader.first, GL_COMPILE_STATUS, &result);
+        if (GL_FALSE == result) {
+            // Compile failed, get log
+            std::string msg;
+            if (!shader.second.empty()) {
+                msg = shader.second + ": shader compliation failed\n";
+            }
+            else {
+                msg = "Shader compilation failed.\n";
+            }
+
+            int length = 0;
+            glGetShaderiv(shader.first, GL_INFO_LOG_LENGTH, &length);
+            if (length > 0) {
+                std::string log(length, ' ');
+                int written = 0;
+                glGetShaderInfoLog(shader.first, length, &written, &log[0]);
+                msg += log;
+            }
+            compiling.clear();
+            detachAndDeleteShaderObjects();
+            throw GLSLProgramException(msg);
+        }
+    }
+    compiling.clear();
+
 	int status = 0;
 	std::string errString;
 	glGetProgramiv(handle, GL_LINK_STATUS, &status);
@@ -190,7 +523,9 @@ void GLSLProgram::link() {
 	}
 	else {
 		findUniformLocations();
+		shadows.clear();
 		linked = true;
+		if (!fromBinary && !binaryName.empty()) saveBinary(binaryName, key);
 	}
 	 
 	detachAndDeleteShaderObjects();
@@ -198,6 +533,51 @@ void GLSLProgram::link() {
 	if( GL_FALSE == status ) throw GLSLProgramException(errString);
 }
 
+GLint GLSLProgram::resolveUniform(const char *name, GLenum type) {
+    if (!linked) throw GLSLProgramException(string("Uniform ") + name + " resolved before the program was linked");
+
+    GLint location = glGetUniformLocation(handle, name);
+    if (location < 0) return -1;
+
+    // Arrays are one resource, named for their first element
+    string base(name);
+    size_t bracket = base.find('[');
+    if (bracket != string::npos) base.erase(bracket);
+    GLuint index = glGetProgramResourceIndex(handle, GL_UNIFORM, base.c_str());
+    if (index == GL_INVALID_INDEX) return location;
+
+    GLenum property = GL_TYPE;
+    GLint declared = 0;
+    glGetProgramResourceiv(handle, GL_UNIFORM, index, 1, &property, 1, NULL, &declared);
+
+    if (!typeMatches(declared, type)) {
+        throw GLSLProgramException(string("Uniform ") + name + " is " + getTypeString(declared) +
+                                   " in the shader, not " + getTypeString(type));
+    }
+    return location;
+}
+
+GLint GLSLProgram::resolveUniform(GLint location, GLenum type) {
+    if (!linked) throw GLSLProgramException("Uniform resolved before the program was linked");
+
+    // No names to go by, so look for the active uniform covering the location
+    GLint count = 0;
+    glGetProgramInterfaceiv(handle, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    const GLenum properties[] = { GL_LOCATION, GL_ARRAY_SIZE, GL_TYPE };
+    for (GLint i = 0; i < count; ++i) {
+        GLint values[3] = {};
+        glGetProgramResourceiv(handle, GL_UNIFORM, i, 3, properties, 3, NULL, values);
+        if (values[0] < 0 || location < values[0] || location >= values[0] + std::max(values[1], 1)) continue;
+
+        if (!typeMatches(values[2], type)) {
+            throw GLSLProgramException("Uniform at location " + std::to_string(location) + " is " +
+                                       getTypeString(values[2]) + " in the shader, not " + getTypeString(type));
+        }
+        return location;
+    }
+    return -1;
+}
+
 void GLSLProgram::findUniformLocations() {
     uniformLocations.clear();
 
@@ -254,6 +634,10 @@ bool GLSLProgram::isLinked() {
     return linked;
 }
 
+bool GLSLProgram::isFromBinary() {
+    return fromBinary;
+}
+
 void GLSLProgram::bindAttribLocation(GLuint location, const char *name) {
     glBindAttribLocation(handle, location, name);
 }
@@ -262,53 +646,67 @@ void GLSLProgram::bindFragDataLocation(GLuint location, const char *name) {
     glBindFragDataLocation(handle, location, name);
 }
 
+bool GLSLProgram::uniformChanged(GLint location, const void *data, size_t size) {
+    if (location < 0) return false;
+    if (location >= (GLint)shadows.size()) shadows.resize(location + 1);
+
+    std::vector<unsigned char> &last = shadows[location];
+    if (last.size() == size && memcmp(last.data(), data, size) == 0) {
+        ++uniformCounters.elided;
+        return false;
+    }
+    last.assign((const unsigned char *)data, (const unsigned char *)data + size);
+    ++uniformCounters.issued;
+    return true;
+}
+
 void GLSLProgram::setUniform(const char *name, float x, float y, float z) {
-    GLint loc = getUniformLocation(name);
-    glUniform3f(loc, x, y, z);
+    this->setUniform(name, glm::vec3(x, y, z));
 }
 
 void GLSLProgram::setUniform(const char *name, const glm::vec3 &v) {
-    this->setUniform(name, v.x, v.y, v.z);
+    GLint loc = getUniformLocation(name);
+    if (uniformChanged(loc, &v, sizeof(v))) glUniform3f(loc, v.x, v.y, v.z);
 }
 
 void GLSLProgram::setUniform(const char *name, const glm::vec4 &v) {
     GLint loc = getUniformLocation(name);
-    glUniform4f(loc, v.x, v.y, v.z, v.w);
+    if (uniformChanged(loc, &v, sizeof(v))) glUniform4f(loc, v.x, v.y, v.z, v.w);
 }
 
 void GLSLProgram::setUniform(const char *name, const glm::vec2 &v) {
     GLint loc = getUniformLocation(name);
-    glUniform2f(loc, v.x, v.y);
+    if (uniformChanged(loc, &v, sizeof(v))) glUniform2f(loc, v.x, v.y);
 }
 
 void GLSLProgram::setUniform(const char *name, const glm::mat4 &m) {
     GLint loc = getUniformLocation(name);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, &m[0][0]);
+    if (uniformChanged(loc, &m, sizeof(m))) glUniformMatrix4fv(loc, 1, GL_FALSE, &m[0][0]);
 }
 
 void GLSLProgram::setUniform(const char *name, const glm::mat3 &m) {
     GLint loc = getUniformLocation(name);
-    glUniformMatrix3fv(loc, 1, GL_FALSE, &m[0][0]);
+    if (uniformChanged(loc, &m, sizeof(m))) glUniformMatrix3fv(loc, 1, GL_FALSE, &m[0][0]);
 }
 
 void GLSLProgram::setUniform(const char *name, float val) {
     GLint loc = getUniformLocation(name);
-    glUniform1f(loc, val);
+    if (uniformChanged(loc, &val, sizeof(val))) glUniform1f(loc, val);
 }
 
 void GLSLProgram::setUniform(const char *name, int val) {
     GLint loc = getUniformLocation(name);
-    glUniform1i(loc, val);
+    if (uniformChanged(loc, &val, sizeof(val))) glUniform1i(loc, val);
 }
 
 void GLSLProgram::setUniform(const char *name, GLuint val) {
     GLint loc = getUniformLocation(name);
-    glUniform1ui(loc, val);
+    if (uniformChanged(loc, &val, sizeof(val))) glUniform1ui(loc, val);
 }
 
 void GLSLProgram::setUniform(const char *name, bool val) {
     int loc = getUniformLocation(name);
-    glUniform1i(loc, val);
+    if (uniformChanged(loc, &val, sizeof(val))) glUniform1i(loc, val);
 }
 
 void GLSLProgram::printActiveUniforms() {
@@ -536,3 +934,167 @@ bool GLSLProgram::fileExists(const string &fileName) {
     ret = stat(fileName.c_str(), &info);
     return 0 == ret;
 }
+
+void GLSLProgram::benchmarkUniforms(int frames) {
+    // The loose uniforms basic_uniform had before its blocks, all kept
+    // active so none resolve to -1
+    const char *vs =
+        "#version 460\n"
+        "uniform mat4 uModel, uView, uProj;\n"
+        "uniform vec3 uPosScale, uPosOffset;\n"
+        "layout (location = 0) in vec3 VertexPosition;\n"
+        "out vec3 vWorldPos;\n"
+        "void main() {\n"
+        "    vec4 world = uModel * vec4(uPosOffset + uPosScale * VertexPosition, 1.0);\n"
+        "    vWorldPos = world.xyz;\n"
+        "    gl_Position = uProj * uView * world;\n"
+        "}\n";
+    const char *fs =
+        "#version 460\n"
+        "uniform vec3 uViewPos, uLightPos, uLightColor, uSpotDir, uFogColor, uBaseColor;\n"
+        "uniform float uAmbientStrength, uSpecStrength, uShininess, uInnerCutoff, uOuterCutoff, uFogNear, uFogFar;\n"
+        "uniform int uFog, uUseSpotlight, uUseMaterial, uUseObjects;\n"
+        "in vec3 vWorldPos;\n"
+        "layout (location = 0) out vec4 FragColor;\n"
+        "void main() {\n"
+        "    vec3 c = uBaseColor * uLightColor * uAmbientStrength + uSpecStrength * pow(uInnerCutoff, uShininess);\n"
+        "    c += dot(uSpotDir, normalize(uLightPos - vWorldPos)) * uOuterCutoff;\n"
+        "    float f = clamp((length(uViewPos - vWorldPos) - uFogNear) / (uFogFar - uFogNear), 0.0, 1.0);\n"
+        "    c = mix(c, uFogColor, f * float(uFog + uUseSpotlight + uUseMaterial + uUseObjects));\n"
+        "    FragColor = vec4(c, 1.0);\n"
+        "}\n";
+
+    GLSLProgram prog;
+    try {
+        prog.compileShader(std::string(vs), GLSLShader::VERTEX);
+        prog.compileShader(std::string(fs), GLSLShader::FRAGMENT);
+        prog.link();
+    }
+    catch (GLSLProgramException &e) {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+    prog.use();
+
+    // What SceneBasic_Uniform::render set each frame, plus one object.
+    // The vectors and matrices change every frame, so only the ints can
+    // be skipped as repeats.
+    glm::mat4 m(1.0f);
+    glm::vec3 v(0.5f);
+    const int calls = 24;
+
+    auto byName = [&prog, &m, &v](int i) {
+        prog.setUniform("uLightColor", v);
+        prog.setUniform("uAmbientStrength", 0.3f);
+        prog.setUniform("uSpecStrength", 0.65f);
+        prog.setUniform("uViewPos", v);
+        prog.setUniform("uLightPos", v);
+        prog.setUniform("uShininess", 64.0f);
+        prog.setUniform("uView", m);
+        prog.setUniform("uProj", m);
+        prog.setUniform("uFog", i & 1);
+        prog.setUniform("uUseSpotlight", 0);
+        prog.setUniform("uSpotDir", v);
+        prog.setUniform("uInnerCutoff", 0.97f);
+        prog.setUniform("uOuterCutoff", 0.95f);
+        prog.setUniform("uFogColor", v);
+        prog.setUniform("uFogNear", 6.0f);
+        prog.setUniform("uFogFar", 25.0f);
+        prog.setUniform("uUseMaterial", 0);
+        prog.setUniform("uUseObjects", 1);
+        prog.setUniform("uUseObjects", 0);
+        prog.setUniform("uModel", m);
+        prog.setUniform("uPosScale", v);
+        prog.setUniform("uPosOffset", v);
+        prog.setUniform("uBaseColor", v);
+        prog.setUniform("uUseMaterial", 1);
+    };
+
+    Uniform<glm::vec3> lightColor = prog.uniform<glm::vec3>("uLightColor");
+    Uniform<float> ambient = prog.uniform<float>("uAmbientStrength");
+    Uniform<float> spec = prog.uniform<float>("uSpecStrength");
+    Uniform<glm::vec3> viewPos = prog.uniform<glm::vec3>("uViewPos");
+    Uniform<glm::vec3> lightPos = prog.uniform<glm::vec3>("uLightPos");
+    Uniform<float> shininess = prog.uniform<float>("uShininess");
+    Uniform<glm::mat4> view = prog.uniform<glm::mat4>("uView");
+    Uniform<glm::mat4> proj = prog.uniform<glm::mat4>("uProj");
+    Uniform<int> fog = prog.uniform<int>("uFog");
+    Uniform<int> useSpotlight = prog.uniform<int>("uUseSpotlight");
+    Uniform<glm::vec3> spotDir = prog.uniform<glm::vec3>("uSpotDir");
+    Uniform<float> inner = prog.uniform<float>("uInnerCutoff");
+    Uniform<float> outer = prog.uniform<float>("uOuterCutoff");
+    Uniform<glm::vec3> fogColor = prog.uniform<glm::vec3>("uFogColor");
+    Uniform<float> fogNear = prog.uniform<float>("uFogNear");
+    Uniform<float> fogFar = prog.uniform<float>("uFogFar");
+    Uniform<int> useMaterial = prog.uniform<int>("uUseMaterial");
+    Uniform<int> useObjects = prog.uniform<int>("uUseObjects");
+    Uniform<glm::mat4> model = prog.uniform<glm::mat4>("uModel");
+    Uniform<glm::vec3> posScale = prog.uniform<glm::vec3>("uPosScale");
+    Uniform<glm::vec3> posOffset = prog.uniform<glm::vec3>("uPosOffset");
+    Uniform<glm::vec3> baseColor = prog.uniform<glm::vec3>("uBaseColor");
+
+    auto byHandle = [&](int i) {
+        lightColor.set(v);
+        ambient.set(0.3f);
+        spec.set(0.65f);
+        viewPos.set(v);
+        lightPos.set(v);
+        shininess.set(64.0f);
+        view.set(m);
+        proj.set(m);
+        fog.set(i & 1);
+        useSpotlight.set(0);
+        spotDir.set(v);
+        inner.set(0.97f);
+        outer.set(0.95f);
+        fogColor.set(v);
+        fogNear.set(6.0f);
+        fogFar.set(25.0f);
+        useMaterial.set(0);
+        useObjects.set(1);
+        useObjects.set(0);
+        model.set(m);
+        posScale.set(v);
+        posOffset.set(v);
+        baseColor.set(v);
+        useMaterial.set(1);
+    };
+
+    // Alternate in blocks so clock changes hit all equally. The last case
+    // repeats one frame's values, so the shadow copies skip every call.
+    const int block = 500;
+    double nameMs = 0.0, handleMs = 0.0, repeatMs = 0.0;
+    for (int f = 0; f < frames; f += block) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < block; ++i) {
+            v.x = m[3][0] = float(f + i);
+            byName(i);
+        }
+        glFinish();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < block; ++i) {
+            v.x = m[3][0] = float(f + i);
+            byHandle(i);
+        }
+        glFinish();
+        auto t2 = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < block; ++i) byHandle(0);
+        glFinish();
+        auto t3 = std::chrono::high_resolution_clock::now();
+        if (f > 0) {     // first block is warm-up
+            nameMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            handleMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            repeatMs += std::chrono::duration<double, std::milli>(t3 - t2).count();
+        }
+    }
+
+    const double n = double(frames - block);
+    const UniformStats &stats = prog.uniformStats();
+    printf("Uniform updates: %d per frame, %d frames\n", calls, frames - block);
+    printf("  setUniform(name)       %8.2f us/frame, %6.1f ns/call\n", 1000.0 * nameMs / n, 1.0e6 * nameMs / (n * calls));
+    printf("  Uniform<T>::set        %8.2f us/frame, %6.1f ns/call (%.2fx)\n", 1000.0 * handleMs / n,
+           1.0e6 * handleMs / (n * calls), nameMs / handleMs);
+    printf("  Uniform<T>::set, same  %8.2f us/frame, %6.1f ns/call (%.2fx)\n", 1000.0 * repeatMs / n,
+           1.0e6 * repeatMs / (n * calls), nameMs / repeatMs);
+    printf("  %zu sets issued, %zu skipped as repeats\n", stats.issued, stats.elided);
+}
@@ -6,11 +6,20 @@
 
 #include <glad/glad.h>
 
+#include <cstdint>
 #include <string>
 #include <map>
+#include <utility>
+#include <vector>
 #include <glm/glm.hpp>
 #include <stdexcept>
 
+// KHR_parallel_shader_compile; the extension is not in the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
 class GLSLProgramException : public std::runtime_error {
 public:
     GLSLProgramException(const std::string &msg) :
@@ -28,16 +37,114 @@ namespace GLSLShader {
     };
 };
 
+class GLSLProgram;
+
+// A uniform's location in one program, looked up once after link; set()
+// is then a single glProgramUniform* call, with no name lookup and no
+// need for the program to be bound. A uniform the compiler removed has
+// location -1, which GL ignores, so setting it does nothing. Like
+// setUniform, set() skips the call when the value is the one last sent.
+template <typename T>
+class Uniform {
+public:
+    Uniform() : owner(nullptr), program(0), location(-1) {}
+    Uniform(GLSLProgram *owner, GLuint program, GLint location)
+        : owner(owner), program(program), location(location) {}
+
+    void set(const T &v) const;
+    void set(const T *v, GLsizei count) const;     // an array, from element 0
+
+    bool isActive() const { return location >= 0; }
+
+private:
+    GLSLProgram *owner;
+    GLuint program;
+    GLint location;
+
+    bool changed(const void *v, size_t size) const;
+};
+
+namespace GLSLShader {
+    // GL type a Uniform<T> may be bound to; int also covers samplers
+    template <typename T> struct UniformType;
+    template <> struct UniformType<float> { static const GLenum value = GL_FLOAT; };
+    template <> struct UniformType<int> { static const GLenum value = GL_INT; };
+    template <> struct UniformType<GLuint> { static const GLenum value = GL_UNSIGNED_INT; };
+    template <> struct UniformType<bool> { static const GLenum value = GL_BOOL; };
+    template <> struct UniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+    template <> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+    template <> struct UniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+    template <> struct UniformType<glm::mat3> { static const GLenum value = GL_FLOAT_MAT3; };
+    template <> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+}
+
+// Shaders given to compileShader are compiled in link(), and only if the
+// program isn't in the binary cache: a .progbin file beside the first
+// shader file, holding what glGetProgramBinary returned last time. It is
+// keyed on the shader sources as compiled (so defines, see define(),
+// count) and the driver's vendor, renderer and version strings. A
+// stale key, or a binary the driver rejects, falls back to compiling from
+// source and rewrites the file. Programs built from strings alone have
+// nowhere to cache and always compile. SPIR-V shaders are cached the same
+// way, keyed on the module and its specialization constants.
+//
+// link() blocks until the program is ready. linkAsync() only submits the
+// compile and link; with KHR_parallel_shader_compile (see
+// enableParallelCompile) the driver works on every submitted program at
+// once, isLinkDone() asks without waiting, and finishLink() reports
+// compile and link errors once they are known.
 class GLSLProgram {
+public:
+    // Values sent to GL, and sets skipped for repeating the last value,
+    // through both setUniform and Uniform<T>.
+    struct UniformStats {
+        size_t issued = 0;
+        size_t elided = 0;
+    };
+
 private:
+    struct PendingShader {
+        GLSLShader::GLSLShaderType type;
+        std::string source;         // SPIR-V words when spirv
+        std::string fileName;
+        bool spirv;
+    };
+
+    template <typename T> friend class Uniform;
+
     GLuint handle;
     bool linked;
+    bool linking;
+    bool fromBinary;
+    std::vector<PendingShader> pending;
+    std::vector<std::pair<std::string, std::string>> defines;  // name, value
+    std::vector<std::pair<GLuint, GLuint>> constants;          // specialization constant id, value
+    std::vector<std::pair<GLuint, std::string>> compiling;     // shader, file name
+    std::string binaryName;
+    uint64_t key;
     std::map<std::string, int> uniformLocations;
 
+    // The bytes last sent to each location. A value only GL knows about,
+    // from a direct glUniform call or an array element set on its own,
+    // isn't tracked.
+    std::vector<std::vector<unsigned char>> shadows;
+    UniformStats uniformCounters;
+
+    bool uniformChanged(GLint location, const void *data, size_t size);
+
     inline GLint getUniformLocation(const char *name);
 	void detachAndDeleteShaderObjects();
     bool fileExists(const std::string &fileName);
     std::string getExtension(const char *fileName);
+    std::string withDefines(const std::string &source) const;
+
+    GLint resolveUniform(const char *name, GLenum type);
+    GLint resolveUniform(GLint location, GLenum type);
+    void compilePending();
+    std::string binaryFileName() const;
+    uint64_t binaryKey() const;
+    bool loadBinary(const std::string &fileName, uint64_t key);
+    void saveBinary(const std::string &fileName, uint64_t key);
 
 public:
     GLSLProgram();
@@ -52,16 +159,61 @@ public:
     void compileShader(const std::string &source, GLSLShader::GLSLShaderType type,
                        const char *fileName = NULL);
 
+    // Adds "#define name value" just after the #version line of every
+    // shader compiled from now on, with a #line to keep error messages'
+    // line numbers those of the file. The defines' names are also added to
+    // the binary cache's file name, so each variant has a file of its own.
+    void define(const std::string &name, const std::string &value = "1");
+
+    // A SPIR-V module (GL_ARB_gl_spirv), such as the shader build step
+    // writes to spv/ beside the GLSL: fileName is the GLSL file's name with
+    // .spv added, which gives the stage. Frontend parsing is done offline,
+    // so the driver only specializes it, in link(), with the constants
+    // given to specialize(). A SPIR-V program has no uniform names; its
+    // uniforms need explicit locations.
+    void compileSpirv(const char *fileName);
+    void specialize(GLuint constantId, GLuint value);
+
+    // Whether the driver takes SPIR-V shaders. Needs a current context.
+    static bool spirvSupported();
+
+    // Lets the driver compile on its own threads, as many as it likes.
+    // Returns false, and changes nothing, without the extension. Needs a
+    // current context; applies to that context.
+    static bool enableParallelCompile();
+
     void link();
+    void linkAsync();
+    bool isLinkDone();
+    void finishLink();      // waits if need be; throws as link() does
     void validate();
     void use();
 
     int getHandle();
     bool isLinked();
 
+    // Whether link() found the program in the binary cache.
+    bool isFromBinary();
+
     void bindAttribLocation(GLuint location, const char *name);
     void bindFragDataLocation(GLuint location, const char *name);
 
+    // Resolves a uniform for Uniform<T>::set. Throws if the program isn't
+    // linked or the shader declares the name with a different type.
+    template <typename T>
+    Uniform<T> uniform(const char *name) {
+        return Uniform<T>(this, handle, resolveUniform(name, GLSLShader::UniformType<T>::value));
+    }
+
+    // The same for a uniform the shader gives an explicit location, which
+    // is all a program from SPIR-V can be reached by.
+    template <typename T>
+    Uniform<T> uniform(GLint location) {
+        return Uniform<T>(this, handle, resolveUniform(location, GLSLShader::UniformType<T>::value));
+    }
+
+    const UniformStats &uniformStats() const { return uniformCounters; }
+
     void setUniform(const char *name, float x, float y, float z);
     void setUniform(const char *name, const glm::vec2 &v);
     void setUniform(const char *name, const glm::vec3 &v);
@@ -79,8 +231,60 @@ public:
     void printActiveAttribs();
 
     const char *getTypeString(GLenum type);
+
+    // Times a frame's worth of loose uniform updates, as the render loop
+    // made before it had uniform blocks, through setUniform(name) against
+    // Uniform<T> handles, then again with nothing changed. Needs a current
+    // GL 4.6 context.
+    static void benchmarkUniforms(int frames = 20000);
 };
 
+template <typename T>
+bool Uniform<T>::changed(const void *v, size_t size) const {
+    return location >= 0 && owner->uniformChanged(location, v, size);
+}
+
+template <> inline void Uniform<float>::set(const float &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform1f(program, location, v);
+}
+template <> inline void Uniform<int>::set(const int &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform1i(program, location, v);
+}
+template <> inline void Uniform<GLuint>::set(const GLuint &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform1ui(program, location, v);
+}
+template <> inline void Uniform<bool>::set(const bool &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform1i(program, location, v);
+}
+template <> inline void Uniform<glm::vec2>::set(const glm::vec2 &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform2f(program, location, v.x, v.y);
+}
+template <> inline void Uniform<glm::vec3>::set(const glm::vec3 &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform3f(program, location, v.x, v.y, v.z);
+}
+template <> inline void Uniform<glm::vec4>::set(const glm::vec4 &v) const {
+    if (changed(&v, sizeof(v))) glProgramUniform4f(program, location, v.x, v.y, v.z, v.w);
+}
+template <> inline void Uniform<glm::mat3>::set(const glm::mat3 &m) const {
+    if (changed(&m, sizeof(m))) glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, &m[0][0]);
+}
+template <> inline void Uniform<glm::mat4>::set(const glm::mat4 &m) const {
+    if (changed(&m, sizeof(m))) glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, &m[0][0]);
+}
+
+template <> inline void Uniform<float>::set(const float *v, GLsizei count) const {
+    if (changed(v, sizeof(*v) * count)) glProgramUniform1fv(program, location, count, v);
+}
+template <> inline void Uniform<int>::set(const int *v, GLsizei count) const {
+    if (changed(v, sizeof(*v) * count)) glProgramUniform1iv(program, location, count, v);
+}
+template <> inline void Uniform<glm::vec4>::set(const glm::vec4 *v, GLsizei count) const {
+    if (changed(v, sizeof(*v) * count)) glProgramUniform4fv(program, location, count, &v[0][0]);
+}
+template <> inline void Uniform<glm::mat4>::set(const glm::mat4 *m, GLsizei count) const {
+    if (changed(m, sizeof(*m) * count)) glProgramUniformMatrix4fv(program, location, count, GL_FALSE, &m[0][0][0]);
+}
+
 int GLSLProgram::getUniformLocation(const char *name) {
 	auto pos = uniformLocations.find(name);
 
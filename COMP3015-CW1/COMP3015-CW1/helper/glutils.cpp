@@ -2,6 +2,7 @@
 #include <glad/glad.h>
 
 #include <cstdio>
+#include <cstring>
 #include <string>
 using std::string;
 #include <iostream>
@@ -129,6 +130,16 @@ int checkForOpenGLError(const char * file, int line) {
     return retCode;
 }
 
+bool hasExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
 void dumpGLInfo(bool dumpExtensions) {
     const GLubyte *renderer = glGetString( GL_RENDERER );
     const GLubyte *vendor = glGetString( GL_VENDOR );
@@ -7,6 +7,9 @@ namespace GLUtils
     int checkForOpenGLError(const char *, int);
     
     void dumpGLInfo(bool dumpExtensions = false);
+
+    // Whether the current context lists the extension, e.g. "GL_ARB_gl_spirv".
+    bool hasExtension(const char *name);
     
     void APIENTRY debugCallback( GLenum source, GLenum type, GLuint id,
 		GLenum severity, GLsizei length, const GLchar * msg, const void * param );
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Hash
+{
+    // MurmurHash64A. Not cryptographic; used to key on-disk caches
+    // to the content of the files they were built from.
+    inline uint64_t bytes(const void *data, size_t len, uint64_t seed = 0) {
+        const uint64_t m = 0xc6a4a7935bd1e995ULL;
+        const int r = 47;
+
+        uint64_t h = seed ^ (len * m);
+
+        const unsigned char *p = (const unsigned char *)data;
+        const unsigned char *end = p + (len & ~size_t(7));
+        for (; p != end; p += 8) {
+            uint64_t k;
+            memcpy(&k, p, 8);
+
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+
+            h ^= k;
+            h *= m;
+        }
+
+        switch (len & 7) {
+        case 7: h ^= uint64_t(p[6]) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(p[5]) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(p[4]) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(p[3]) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(p[2]) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(p[1]) << 8; [[fallthrough]];
+        case 1: h ^= uint64_t(p[0]);
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    inline uint64_t combine(uint64_t seed, uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+}
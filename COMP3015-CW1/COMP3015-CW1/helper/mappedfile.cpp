@@ -0,0 +1,112 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : ptr(nullptr), length(0), opened(false),
+    fileHandle(INVALID_HANDLE_VALUE), mapHandle(nullptr) {}
+#else
+MappedFile::MappedFile() : ptr(nullptr), length(0), opened(false), fd(-1) {}
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *fileName) {
+    close();
+
+    fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        close();
+        return false;
+    }
+
+    length = (size_t)fileSize.QuadPart;
+    opened = true;
+    if (length == 0) return true;   // Zero-length files cannot be mapped
+
+    mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapHandle == nullptr) {
+        close();
+        return false;
+    }
+
+    ptr = (const char *)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+    if (ptr == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mapHandle) CloseHandle(mapHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+
+    ptr = nullptr;
+    length = 0;
+    opened = false;
+    mapHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const char *fileName) {
+    close();
+
+    fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close();
+        return false;
+    }
+
+    length = (size_t)info.st_size;
+    opened = true;
+    if (length == 0) return true;   // Zero-length files cannot be mapped
+
+    void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    madvise(p, length, MADV_SEQUENTIAL);
+    ptr = (const char *)p;
+    return true;
+}
+
+void MappedFile::close() {
+    if (ptr) munmap((void *)ptr, length);
+    if (fd >= 0) ::close(fd);
+
+    ptr = nullptr;
+    length = 0;
+    opened = false;
+    fd = -1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only view of a whole file mapped into the address space.
+// Used by the asset loaders so they can parse in place without
+// copying the file through a stream buffer.
+class MappedFile {
+private:
+    const char *ptr;
+    size_t length;
+    bool opened;
+#ifdef _WIN32
+    void *fileHandle;
+    void *mapHandle;
+#else
+    int fd;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Make it non-copyable.
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    bool open(const char *fileName);
+    void close();
+
+    // An empty file opens successfully with data() == nullptr and size() == 0.
+    const char *data() const { return ptr; }
+    size_t size() const { return length; }
+    bool isOpen() const { return opened; }
+};
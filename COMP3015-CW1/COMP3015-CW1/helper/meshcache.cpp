@@ -0,0 +1,324 @@
+#include "meshcache.h"
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'M', 'C', 'H' };
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t payloadHash;   // hash of everything after the header
+    uint64_t fileSize;
+    uint32_t materialCount;
+    uint32_t partCount;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    uint32_t lodCount;
+    uint64_t stringOffset;
+    uint64_t stringBytes;
+    uint64_t vertexOffset;
+    uint64_t vertexMaterialOffset;
+    uint64_t indexOffset;
+    uint64_t packedOffset;  // vertexCount PackedVertex
+    float packOffset[3];
+    float packScale[3];
+    uint64_t meshletOffset;
+    uint64_t lodMeshletOffset;
+    uint32_t meshletCount;
+    uint32_t levelCount;
+    uint32_t reserved[2];
+};
+
+// Strings are offsets and lengths into the blob at stringOffset
+struct FileMaterial {
+    uint32_t name;
+    uint32_t nameLength;
+    uint32_t mapKd;
+    uint32_t mapKdLength;
+    float kd[3];
+    float ks[3];
+    float ns;
+    float d;
+};
+
+static_assert(sizeof(FileHeader) % 16 == 0, "header must keep payload aligned");
+static_assert(sizeof(FileMaterial) % 16 == 0, "material table must keep payload aligned");
+static_assert(sizeof(ObjModel::Part) == 20, "part table layout changed");
+static_assert(sizeof(ObjModel::Lod) == 12, "LOD table layout changed");
+static_assert(sizeof(PackedVertex) == 16, "packed vertex layout changed");
+static_assert(sizeof(Meshlet) % 16 == 0, "meshlet table must keep payload aligned");
+
+inline uint64_t alignUp(uint64_t v) { return (v + 15) & ~uint64_t(15); }
+
+// Appends str to the blob; its offset and length go in the table
+void addString(std::string &blob, const std::string &str, uint32_t &offset, uint32_t &length) {
+    offset = (uint32_t)blob.size();
+    length = (uint32_t)str.size();
+    blob += str;
+}
+
+bool readString(const char *blob, uint64_t blobBytes, uint32_t offset, uint32_t length, std::string &out) {
+    if (uint64_t(offset) + length > blobBytes) return false;
+    out.assign(blob + offset, length);
+    return true;
+}
+
+} // namespace
+
+bool MeshCache::hashSources(const std::vector<std::string> &files, uint64_t &outHash) {
+    uint64_t h = VERSION;
+    for (const std::string &name : files) {
+        MappedFile f;
+        if (!f.open(name.c_str())) return false;
+        h = Hash::combine(h, Hash::bytes(f.data(), f.size(), f.size()));
+    }
+    outHash = h;
+    return true;
+}
+
+bool MeshCache::write(const char *fileName, uint64_t sourceHash, const ObjModel &model, const MeshBuffers &buffers) {
+    if (buffers.packed.size() != model.vertices.size() ||
+        buffers.lodMeshlets.size() != std::max<size_t>(model.lods.size(), 1)) {
+        return false;
+    }
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.sourceHash = sourceHash;
+    header.materialCount = (uint32_t)model.materials.size();
+    header.partCount = (uint32_t)model.parts.size();
+    header.vertexCount = (uint32_t)model.vertices.size();
+    header.indexCount = (uint32_t)model.indices.size();
+    header.indexSize = model.vertices.size() <= 0x10000 ? 2 : 4;
+    header.lodCount = (uint32_t)model.lods.size();
+
+    std::vector<FileMaterial> fileMaterials(model.materials.size());
+    std::string strings;
+    for (size_t i = 0; i < model.materials.size(); ++i) {
+        const ObjMaterial &m = model.materials[i];
+        FileMaterial &fm = fileMaterials[i];
+        memset(&fm, 0, sizeof(fm));
+        addString(strings, m.name, fm.name, fm.nameLength);
+        addString(strings, m.mapKd, fm.mapKd, fm.mapKdLength);
+        memcpy(fm.kd, &m.kd[0], sizeof(fm.kd));
+        memcpy(fm.ks, &m.ks[0], sizeof(fm.ks));
+        fm.ns = m.ns;
+        fm.d = m.d;
+    }
+
+    uint64_t offset = sizeof(FileHeader);
+    offset += uint64_t(header.materialCount) * sizeof(FileMaterial);
+    offset += uint64_t(header.partCount) * sizeof(ObjModel::Part);
+    offset += uint64_t(header.lodCount) * sizeof(ObjModel::Lod);
+    header.stringOffset = offset;
+    header.stringBytes = strings.size();
+    offset = alignUp(offset + header.stringBytes);
+    header.vertexOffset = offset;
+    offset = alignUp(offset + uint64_t(header.vertexCount) * sizeof(ObjVertex));
+    header.vertexMaterialOffset = offset;
+    offset = alignUp(offset + uint64_t(header.vertexCount) * sizeof(uint16_t));
+    header.indexOffset = offset;
+    offset = alignUp(offset + uint64_t(header.indexCount) * header.indexSize);
+    header.packedOffset = offset;
+    offset = alignUp(offset + uint64_t(header.vertexCount) * sizeof(PackedVertex));
+    header.meshletOffset = offset;
+    header.meshletCount = (uint32_t)buffers.meshlets.size();
+    offset = alignUp(offset + uint64_t(header.meshletCount) * sizeof(Meshlet));
+    header.lodMeshletOffset = offset;
+    header.levelCount = (uint32_t)buffers.lodMeshlets.size();
+    offset = alignUp(offset + uint64_t(header.levelCount) * sizeof(uint32_t));
+    header.fileSize = offset;
+    memcpy(header.packOffset, &buffers.bounds.offset[0], sizeof(header.packOffset));
+    memcpy(header.packScale, &buffers.bounds.scale[0], sizeof(header.packScale));
+
+    // Build everything after the header in memory so it can be hashed before writing
+    std::vector<char> payload((size_t)(offset - sizeof(FileHeader)), 0);
+    auto at = [&](uint64_t fileOffset) { return payload.data() + (size_t)(fileOffset - sizeof(FileHeader)); };
+
+    uint64_t tableOffset = sizeof(FileHeader);
+    if (!fileMaterials.empty())
+        memcpy(at(tableOffset), fileMaterials.data(), fileMaterials.size() * sizeof(FileMaterial));
+    tableOffset += fileMaterials.size() * sizeof(FileMaterial);
+
+    if (!model.parts.empty())
+        memcpy(at(tableOffset), model.parts.data(), model.parts.size() * sizeof(ObjModel::Part));
+    tableOffset += model.parts.size() * sizeof(ObjModel::Part);
+    if (!model.lods.empty())
+        memcpy(at(tableOffset), model.lods.data(), model.lods.size() * sizeof(ObjModel::Lod));
+    if (!strings.empty())
+        memcpy(at(header.stringOffset), strings.data(), strings.size());
+    if (!model.vertices.empty()) {
+        memcpy(at(header.vertexOffset), model.vertices.data(), model.vertices.size() * sizeof(ObjVertex));
+        memcpy(at(header.vertexMaterialOffset), model.vertexMaterials.data(), model.vertexMaterials.size() * sizeof(uint16_t));
+    }
+
+    char *dst = at(header.indexOffset);
+    if (header.indexSize == 2) {
+        for (uint32_t idx : model.indices) {
+            uint16_t s = (uint16_t)idx;
+            memcpy(dst, &s, 2);
+            dst += 2;
+        }
+    }
+    else if (!model.indices.empty()) {
+        memcpy(dst, model.indices.data(), model.indices.size() * 4);
+    }
+
+    if (!buffers.packed.empty())
+        memcpy(at(header.packedOffset), buffers.packed.data(), buffers.packed.size() * sizeof(PackedVertex));
+    if (!buffers.meshlets.empty())
+        memcpy(at(header.meshletOffset), buffers.meshlets.data(), buffers.meshlets.size() * sizeof(Meshlet));
+    memcpy(at(header.lodMeshletOffset), buffers.lodMeshlets.data(), buffers.lodMeshlets.size() * sizeof(uint32_t));
+
+    header.payloadHash = Hash::bytes(payload.data(), payload.size());
+
+    // Write to a temporary name first so a crash never leaves a half-written cache
+    std::string tmpName = std::string(fileName) + ".tmp";
+    {
+        std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write((const char *)&header, sizeof(header));
+        out.write(payload.data(), payload.size());
+        if (!out) return false;
+    }
+
+    std::remove(fileName);
+    return std::rename(tmpName.c_str(), fileName) == 0;
+}
+
+bool MeshCache::open(const char *fileName, uint64_t sourceHash) {
+    close();
+    if (!file.open(fileName)) return false;
+
+    const char *base = file.data();
+    const uint64_t size = file.size();
+
+    FileHeader header;
+    if (size < sizeof(header)) { close(); return false; }
+    memcpy(&header, base, sizeof(header));
+
+    if (memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION ||
+        header.sourceHash != sourceHash || header.fileSize != size ||
+        Hash::bytes(base + sizeof(header), (size_t)(size - sizeof(header))) != header.payloadHash) {
+        close();
+        return false;
+    }
+
+    const uint64_t tableEnd = sizeof(FileHeader) + uint64_t(header.materialCount) * sizeof(FileMaterial)
+                            + uint64_t(header.partCount) * sizeof(ObjModel::Part)
+                            + uint64_t(header.lodCount) * sizeof(ObjModel::Lod);
+    if ((header.indexSize != 2 && header.indexSize != 4) ||
+        tableEnd > header.stringOffset || header.stringOffset + header.stringBytes > header.vertexOffset ||
+        header.vertexOffset + uint64_t(header.vertexCount) * sizeof(ObjVertex) > header.vertexMaterialOffset ||
+        header.vertexMaterialOffset + uint64_t(header.vertexCount) * sizeof(uint16_t) > header.indexOffset ||
+        header.indexOffset + uint64_t(header.indexCount) * header.indexSize > header.packedOffset ||
+        header.packedOffset + uint64_t(header.vertexCount) * sizeof(PackedVertex) > header.meshletOffset ||
+        header.meshletOffset + uint64_t(header.meshletCount) * sizeof(Meshlet) > header.lodMeshletOffset ||
+        header.lodMeshletOffset + uint64_t(header.levelCount) * sizeof(uint32_t) > size ||
+        header.levelCount != std::max<uint32_t>(header.lodCount, 1) ||
+        (header.vertexOffset & 15) || (header.vertexMaterialOffset & 15) || (header.indexOffset & 15) ||
+        (header.packedOffset & 15) || (header.meshletOffset & 15) || (header.lodMeshletOffset & 15)) {
+        close();
+        return false;
+    }
+
+    const FileMaterial *mtls = (const FileMaterial *)(base + sizeof(FileHeader));
+    for (uint32_t i = 0; i < header.materialCount; ++i) {
+        FileMaterial fm;
+        memcpy(&fm, &mtls[i], sizeof(fm));
+        ObjMaterial m;
+        const char *strings = base + header.stringOffset;
+        if (!readString(strings, header.stringBytes, fm.name, fm.nameLength, m.name) ||
+            !readString(strings, header.stringBytes, fm.mapKd, fm.mapKdLength, m.mapKd)) {
+            close();
+            return false;
+        }
+        m.kd = glm::vec3(fm.kd[0], fm.kd[1], fm.kd[2]);
+        m.ks = glm::vec3(fm.ks[0], fm.ks[1], fm.ks[2]);
+        m.ns = fm.ns;
+        m.d = fm.d;
+        materialList.push_back(m);
+    }
+
+    partList.resize(header.partCount);
+    if (header.partCount > 0)
+        memcpy(partList.data(), mtls + header.materialCount, header.partCount * sizeof(ObjModel::Part));
+    for (const ObjModel::Part &p : partList) {
+        if (p.material >= header.materialCount ||
+            uint64_t(p.firstIndex) + p.indexCount > header.indexCount ||
+            uint64_t(p.firstVertex) + p.vertexCount > header.vertexCount) {
+            close();
+            return false;
+        }
+    }
+
+    lodList.resize(header.lodCount);
+    if (header.lodCount > 0) {
+        const char *lodTable = (const char *)(mtls + header.materialCount) + header.partCount * sizeof(ObjModel::Part);
+        memcpy(lodList.data(), lodTable, header.lodCount * sizeof(ObjModel::Lod));
+    }
+    for (const ObjModel::Lod &l : lodList) {
+        if (uint64_t(l.firstIndex) + l.indexCount > header.indexCount) {
+            close();
+            return false;
+        }
+    }
+
+    modelView.materials = materialList.data();
+    modelView.materialCount = materialList.size();
+    modelView.parts = partList.data();
+    modelView.partCount = partList.size();
+    modelView.vertices = (const ObjVertex *)(base + header.vertexOffset);
+    modelView.vertexMaterials = (const uint16_t *)(base + header.vertexMaterialOffset);
+    modelView.vertexCount = header.vertexCount;
+    modelView.indices = base + header.indexOffset;
+    modelView.indexCount = header.indexCount;
+    modelView.indexSize = header.indexSize;
+    modelView.lods = lodList.data();
+    modelView.lodCount = lodList.size();
+
+    // Meshlets must draw from the index buffer and account for every level
+    const Meshlet *meshlets = (const Meshlet *)(base + header.meshletOffset);
+    for (uint32_t i = 0; i < header.meshletCount; ++i) {
+        if (uint64_t(meshlets[i].firstIndex) + meshlets[i].indexCount > header.indexCount) {
+            close();
+            return false;
+        }
+    }
+    const uint32_t *lodMeshlets = (const uint32_t *)(base + header.lodMeshletOffset);
+    uint64_t meshletTotal = 0;
+    for (uint32_t i = 0; i < header.levelCount; ++i) meshletTotal += lodMeshlets[i];
+    if (meshletTotal != header.meshletCount) {
+        close();
+        return false;
+    }
+
+    buffersView.packed = (const PackedVertex *)(base + header.packedOffset);
+    buffersView.bounds.offset = glm::vec3(header.packOffset[0], header.packOffset[1], header.packOffset[2]);
+    buffersView.bounds.scale = glm::vec3(header.packScale[0], header.packScale[1], header.packScale[2]);
+    buffersView.meshlets = meshlets;
+    buffersView.meshletCount = header.meshletCount;
+    buffersView.lodMeshlets = lodMeshlets;
+    buffersView.levelCount = header.levelCount;
+    return true;
+}
+
+void MeshCache::close() {
+    materialList.clear();
+    partList.clear();
+    lodList.clear();
+    modelView = ObjModelView();
+    buffersView = MeshBuffersView();
+    file.close();
+}
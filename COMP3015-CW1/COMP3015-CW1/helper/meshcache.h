@@ -0,0 +1,71 @@
+#pragma once
+
+#include "objloader.h"
+#include "mappedfile.h"
+#include "meshlet.h"
+#include "vertexpack.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the renderer builds from a model besides its own arrays, cached
+// with it so a warm start uploads these as they are. Meshlets are built
+// over the model's indices, which are cached in the order they leave.
+struct MeshBuffers {
+    std::vector<PackedVertex> packed;       // one per model vertex
+    PackBounds bounds;
+    std::vector<Meshlet> meshlets;          // level by level, finest first
+    std::vector<uint32_t> lodMeshlets;      // how many each level has; one level if the model has no LODs
+};
+
+// The same, pointing into a mapped cache or a MeshBuffers.
+struct MeshBuffersView {
+    const PackedVertex *packed;
+    PackBounds bounds;
+    const Meshlet *meshlets;
+    size_t meshletCount;
+    const uint32_t *lodMeshlets;
+    size_t levelCount;
+};
+
+// A processed ObjModel in a flat binary file that is memory-mapped on
+// load, so the vertex and index arrays can go straight to glBufferData.
+//
+// Layout (little-endian, every array 16-byte aligned):
+//   Header | Material[materialCount] | Part[partCount] | Lod[lodCount] |
+//   strings | vertices | vertex materials | indices | packed vertices |
+//   meshlets | meshlets per level
+// Material names and texture paths are stored whole in the string blob.
+// The header stores a hash of the source files; a cache built from
+// different sources, an older version or a damaged payload is rejected.
+class MeshCache {
+public:
+    static const uint32_t VERSION = 7;
+
+    // Hash of the concatenated contents of the given files.
+    // Returns false if any of them cannot be read.
+    static bool hashSources(const std::vector<std::string> &files, uint64_t &outHash);
+
+    // Indices are narrowed to 16 bits when the model has <= 65536 vertices,
+    // matching what the renderer uploads.
+    static bool write(const char *fileName, uint64_t sourceHash, const ObjModel &model, const MeshBuffers &buffers);
+
+    MeshCache() = default;
+
+    // Maps and validates the file. Returns false on a missing, stale or corrupt cache.
+    bool open(const char *fileName, uint64_t sourceHash);
+    void close();
+
+    // Arrays point into the mapping and stay valid until close().
+    const ObjModelView &view() const { return modelView; }
+    const MeshBuffersView &buffers() const { return buffersView; }
+
+private:
+    MappedFile file;
+    std::vector<ObjMaterial> materialList;
+    std::vector<ObjModel::Part> partList;
+    std::vector<ObjModel::Lod> lodList;
+    ObjModelView modelView = ObjModelView();
+    MeshBuffersView buffersView = MeshBuffersView();
+};
@@ -0,0 +1,185 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Scores a triangle for joining the meshlet being grown: new vertices it
+// would add, plus a penalty for pointing away from the meshlet's average
+// normal so cones stay narrow enough to cull.
+const float CONE_WEIGHT = 2.0f;
+
+void finish(const uint32_t *indices, size_t first, size_t count, const ObjVertex *vertices,
+            std::vector<Meshlet> &out) {
+    Meshlet m = Meshlet();
+    m.firstIndex = (uint32_t)first;
+    m.indexCount = (uint32_t)count;
+
+    // Sphere around the box centre; a little loose but cheap and stable
+    glm::vec3 lo = vertices[indices[first]].pos, hi = lo;
+    for (size_t i = first; i < first + count; ++i) {
+        lo = glm::min(lo, vertices[indices[i]].pos);
+        hi = glm::max(hi, vertices[indices[i]].pos);
+    }
+    glm::vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (size_t i = first; i < first + count; ++i)
+        radius = std::max(radius, glm::length(vertices[indices[i]].pos - center));
+
+    // Normal cone from the triangles' geometric normals
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (size_t t = first; t + 2 < first + count; t += 3) {
+        const glm::vec3 &p0 = vertices[indices[t]].pos;
+        const glm::vec3 &p1 = vertices[indices[t + 1]].pos;
+        const glm::vec3 &p2 = vertices[indices[t + 2]].pos;
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float len = glm::length(n);
+        if (len <= 0.0f) continue;
+        normals.push_back(n / len);
+        axis += n / len;
+    }
+
+    float cutoff = 1.0f;
+    float axisLen = glm::length(axis);
+    if (axisLen > 0.0f) {
+        axis /= axisLen;
+        float minDot = 1.0f;
+        for (const glm::vec3 &n : normals) minDot = std::min(minDot, glm::dot(axis, n));
+        // Cones wider than a hemisphere can never be entirely back-facing
+        if (minDot > 0.0f) cutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    for (int c = 0; c < 3; ++c) {
+        m.center[c] = center[c];
+        m.coneAxis[c] = axis[c];
+    }
+    m.radius = radius;
+    m.coneCutoff = cutoff;
+    out.push_back(m);
+}
+
+} // namespace
+
+namespace Meshlets {
+
+void build(uint32_t *indices, size_t firstIndex, size_t indexCount,
+           const ObjVertex *vertices, std::vector<Meshlet> &out) {
+    const size_t triCount = indexCount / 3;
+    if (triCount == 0) return;
+    const uint32_t *tris = indices + firstIndex;
+
+    uint32_t vertexCount = 0;
+    for (size_t i = 0; i < triCount * 3; ++i) vertexCount = std::max(vertexCount, tris[i] + 1);
+
+    // Neighbours are found through positions, not vertex indices, so
+    // triangles on either side of a normal or UV seam still count as adjacent
+    std::vector<uint32_t> sorted(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v) sorted[v] = v;
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = vertices[a].pos, &pb = vertices[b].pos;
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        return pa.z < pb.z;
+    });
+    std::vector<uint32_t> group(vertexCount);
+    uint32_t groupCount = 0;
+    for (uint32_t i = 0; i < vertexCount; ++i) {
+        if (i > 0 && vertices[sorted[i]].pos != vertices[sorted[i - 1]].pos) ++groupCount;
+        group[sorted[i]] = groupCount;
+    }
+    ++groupCount;
+
+    // Triangles around each position
+    std::vector<uint32_t> offsets(groupCount + 1, 0);
+    for (size_t i = 0; i < triCount * 3; ++i) ++offsets[group[tris[i]] + 1];
+    for (uint32_t g = 0; g < groupCount; ++g) offsets[g + 1] += offsets[g];
+    std::vector<uint32_t> adjacency(triCount * 3);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triCount * 3; ++i) adjacency[fill[group[tris[i]]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<glm::vec3> normal(triCount, glm::vec3(0.0f));
+    for (size_t t = 0; t < triCount; ++t) {
+        const glm::vec3 &p0 = vertices[tris[t * 3]].pos;
+        const glm::vec3 &p1 = vertices[tris[t * 3 + 1]].pos;
+        const glm::vec3 &p2 = vertices[tris[t * 3 + 2]].pos;
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float len = glm::length(n);
+        if (len > 0.0f) normal[t] = n / len;
+    }
+
+    std::vector<char> emitted(triCount, 0);
+    std::vector<uint32_t> order;
+    order.reserve(triCount * 3);
+    std::vector<uint32_t> used;
+    used.reserve(MAX_VERTICES);
+    std::vector<size_t> starts;
+    size_t cursor = 0;
+
+    auto newVertices = [&](size_t t) {
+        int n = 0;
+        for (int c = 0; c < 3; ++c) {
+            uint32_t v = tris[t * 3 + c];
+            if (std::find(used.begin(), used.end(), v) == used.end() &&
+                std::find(tris + t * 3, tris + t * 3 + c, v) == tris + t * 3 + c)
+                ++n;
+        }
+        return n;
+    };
+
+    auto emit = [&](size_t t) {
+        emitted[t] = 1;
+        for (int c = 0; c < 3; ++c) {
+            uint32_t v = tris[t * 3 + c];
+            order.push_back(v);
+            if (std::find(used.begin(), used.end(), v) == used.end()) used.push_back(v);
+        }
+    };
+
+    // Grow each meshlet from a seed over triangles that touch its vertices
+    for (;;) {
+        while (cursor < triCount && emitted[cursor]) ++cursor;
+        if (cursor == triCount) break;
+
+        starts.push_back(order.size());
+        used.clear();
+        emit(cursor);
+        glm::vec3 axis = normal[cursor];
+        size_t count = 1;
+
+        while (count < MAX_TRIANGLES) {
+            glm::vec3 dir = glm::length(axis) > 0.0f ? glm::normalize(axis) : axis;
+            size_t best = SIZE_MAX;
+            float bestScore = 0.0f;
+            for (uint32_t v : used) {
+                uint32_t g = group[v];
+                for (uint32_t k = offsets[g]; k < offsets[g + 1]; ++k) {
+                    uint32_t t = adjacency[k];
+                    if (emitted[t]) continue;
+                    int added = newVertices(t);
+                    if (used.size() + added > MAX_VERTICES) continue;
+                    float score = float(added) + CONE_WEIGHT * (1.0f - glm::dot(normal[t], dir));
+                    if (best == SIZE_MAX || score < bestScore || (score == bestScore && t < best)) {
+                        best = t;
+                        bestScore = score;
+                    }
+                }
+            }
+            if (best == SIZE_MAX) break;
+            emit(best);
+            axis += normal[best];
+            ++count;
+        }
+    }
+
+    std::copy(order.begin(), order.end(), indices + firstIndex);
+    starts.push_back(order.size());
+    for (size_t i = 0; i + 1 < starts.size(); ++i)
+        finish(indices, firstIndex + starts[i], starts[i + 1] - starts[i], vertices, out);
+}
+
+} // namespace Meshlets
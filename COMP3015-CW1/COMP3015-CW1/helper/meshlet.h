@@ -0,0 +1,33 @@
+#pragma once
+
+#include "objloader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A run of consecutive triangles in an index buffer, small enough to be
+// culled as a unit. std430 layout, matches shader/meshlet_cull.comp.
+struct Meshlet {
+    float center[3];        // bounding sphere, object space
+    float radius;
+    float coneAxis[3];      // average facing direction
+    float coneCutoff;       // sin of the cone's half angle; 1 disables the cone test
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t pad[2];
+};
+
+namespace Meshlets
+{
+    const size_t MAX_VERTICES = 64;
+    const size_t MAX_TRIANGLES = 124;
+
+    // Regroups the triangles of indices[firstIndex, firstIndex + indexCount)
+    // into meshlets, each grown from a seed over triangles sharing its
+    // vertices and facing the same way, and appends them to out. The range
+    // is rewritten in meshlet order, so each one draws straight from the
+    // index buffer.
+    void build(uint32_t *indices, size_t firstIndex, size_t indexCount,
+               const ObjVertex *vertices, std::vector<Meshlet> &out);
+}
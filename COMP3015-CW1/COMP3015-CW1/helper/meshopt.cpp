@@ -0,0 +1,428 @@
+#include "meshopt.h"
+
+#include "glslprogram.h"
+#include "vertexpack.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// FIFO post-transform cache. Each vertex remembers the miss count when it
+// entered; it is still cached while fewer than size misses came after.
+// reset() empties the cache without touching every entry.
+struct FifoCache {
+    std::vector<size_t> entered;
+    size_t clock;
+    int size;
+
+    FifoCache(size_t vertexCount, int cacheSize)
+        : entered(vertexCount, SIZE_MAX), clock(0), size(cacheSize) {}
+
+    bool access(uint32_t v) {
+        if (entered[v] != SIZE_MAX && clock - entered[v] < (size_t)size) return true;
+        entered[v] = clock++;
+        return false;
+    }
+
+    int triangleMisses(const uint32_t *tri) {
+        return int(!access(tri[0])) + int(!access(tri[1])) + int(!access(tri[2]));
+    }
+
+    void reset() { clock += size; }
+};
+
+} // namespace
+
+namespace MeshOpt {
+
+CacheStats analyzeCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, int cacheSize) {
+    CacheStats stats;
+    size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0) return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<char> used(vertexCount, 0);
+    size_t misses = 0, unique = 0;
+    for (size_t i = 0; i < triCount * 3; ++i) {
+        if (!cache.access(indices[i])) ++misses;
+        if (!used[indices[i]]) { used[indices[i]] = 1; ++unique; }
+    }
+
+    stats.acmr = float(misses) / float(triCount);
+    stats.atvr = float(misses) / float(unique);
+    return stats;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount, int cacheSize) {
+    const size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0) return;
+
+    // Triangles around each vertex, and how many of them are still unemitted
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t i = 0; i < triCount * 3; ++i) ++live[indices[i]];
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<uint32_t> adjacency(triCount * 3);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triCount * 3; ++i) adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    // Time stamps start far enough in the past that every vertex is uncached
+    std::vector<int64_t> stamp(vertexCount, 0);
+    int64_t time = cacheSize + 1;
+
+    std::vector<char> emitted(triCount, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> out;
+    out.reserve(triCount * 3);
+    size_t cursor = 0;
+
+    // Next vertex with live triangles: the most recently seen dead end,
+    // otherwise the next one in input order.
+    auto skipDeadEnd = [&]() -> int64_t {
+        while (!deadEnd.empty()) {
+            uint32_t d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0) return d;
+        }
+        while (cursor < vertexCount) {
+            if (live[cursor] > 0) return int64_t(cursor++);
+            ++cursor;
+        }
+        return -1;
+    };
+
+    int64_t fan = skipDeadEnd();
+    while (fan >= 0) {
+        candidates.clear();
+        for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; ++k) {
+            uint32_t t = adjacency[k];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+
+            for (int c = 0; c < 3; ++c) {
+                uint32_t v = indices[t * 3 + c];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - stamp[v] > cacheSize) stamp[v] = time++;
+            }
+        }
+
+        // Prefer the oldest candidate that will still be cached after its own
+        // fan; any live candidate, even at priority 0, beats the dead-end stack
+        fan = -1;
+        int64_t best = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            int64_t priority = 0;
+            if (time - stamp[v] + 2 * int64_t(live[v]) <= cacheSize) priority = time - stamp[v];
+            if (priority > best) {
+                best = priority;
+                fan = v;
+            }
+        }
+        if (fan < 0) fan = skipDeadEnd();
+    }
+
+    std::copy(out.begin(), out.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const ObjVertex *vertices, size_t vertexCount,
+                      float threshold, int cacheSize) {
+    const size_t triCount = indexCount / 3;
+    if (triCount < 2 || vertexCount == 0) return;
+
+    // Hard boundaries: triangles where the cache had nothing to offer anyway
+    std::vector<size_t> hard;
+    {
+        FifoCache cache(vertexCount, cacheSize);
+        for (size_t t = 0; t < triCount; ++t) {
+            if (cache.triangleMisses(indices + t * 3) == 3) hard.push_back(t);
+        }
+    }
+    if (hard.empty() || hard[0] != 0) hard.insert(hard.begin(), 0);
+    hard.push_back(triCount);
+
+    // Soft boundaries: split a hard cluster wherever the running ACMR since
+    // the last split is already within threshold of the whole cluster's
+    std::vector<size_t> clusters;
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t h = 0; h + 1 < hard.size(); ++h) {
+        size_t begin = hard[h], end = hard[h + 1];
+
+        cache.reset();
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; ++t) clusterMisses += cache.triangleMisses(indices + t * 3);
+        float clusterAcmr = float(clusterMisses) / float(end - begin);
+
+        cache.reset();
+        size_t start = begin, misses = 0;
+        clusters.push_back(begin);
+        for (size_t t = begin; t < end; ++t) {
+            misses += cache.triangleMisses(indices + t * 3);
+            if (t + 1 < end && float(misses) / float(t + 1 - start) <= clusterAcmr * threshold) {
+                start = t + 1;
+                misses = 0;
+                cache.reset();
+                clusters.push_back(start);
+            }
+        }
+    }
+    clusters.push_back(triCount);
+
+    // Area-weighted centroid and normal of each cluster and of the whole mesh
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> centroid(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> area(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].pos;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].pos;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid[c] += (p0 + p1 + p2) * (a / 3.0f);
+            normal[c] += n;
+            area[c] += a;
+        }
+        meshCentroid += centroid[c];
+        meshArea += area[c];
+        if (area[c] > 0.0f) centroid[c] /= area[c];
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    // Clusters facing away from the middle of the mesh are the ones most
+    // likely to be in front, so they go first
+    std::vector<float> key(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        float len = glm::length(normal[c]);
+        if (len > 0.0f) key[c] = glm::dot(centroid[c] - meshCentroid, normal[c] / len);
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return key[a] > key[b]; });
+
+    std::vector<uint32_t> out;
+    out.reserve(triCount * 3);
+    for (size_t c : order) {
+        out.insert(out.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    }
+    std::copy(out.begin(), out.end(), indices);
+}
+
+void optimizeVertexFetch(uint32_t *indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap) {
+    remap.assign(vertexCount, UINT32_MAX);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        uint32_t &r = remap[indices[i]];
+        if (r == UINT32_MAX) r = next++;
+        indices[i] = r;
+    }
+
+    // Unreferenced vertices keep their relative order at the end
+    for (uint32_t &r : remap) {
+        if (r == UINT32_MAX) r = next++;
+    }
+}
+
+void optimizeModel(ObjModel &model, CacheStats *before, CacheStats *after) {
+    if (before) *before = analyzeCache(model.indices.data(), model.indices.size(), model.vertices.size());
+
+    std::vector<uint32_t> local, remap;
+    std::vector<ObjVertex> vertexScratch;
+    std::vector<uint16_t> materialScratch;
+
+    for (const ObjModel::Part &part : model.parts) {
+        if (part.indexCount == 0) continue;
+
+        uint32_t *idx = model.indices.data() + part.firstIndex;
+        ObjVertex *verts = model.vertices.data() + part.firstVertex;
+        uint16_t *mats = model.vertexMaterials.data() + part.firstVertex;
+
+        // Work on part-local indices so the vertex range can be permuted on its own
+        local.resize(part.indexCount);
+        for (uint32_t i = 0; i < part.indexCount; ++i) local[i] = idx[i] - part.firstVertex;
+
+        optimizeVertexCache(local.data(), local.size(), part.vertexCount);
+        optimizeOverdraw(local.data(), local.size(), verts, part.vertexCount);
+        optimizeVertexFetch(local.data(), local.size(), part.vertexCount, remap);
+
+        vertexScratch.assign(verts, verts + part.vertexCount);
+        materialScratch.assign(mats, mats + part.vertexCount);
+        for (uint32_t v = 0; v < part.vertexCount; ++v) {
+            verts[remap[v]] = vertexScratch[v];
+            mats[remap[v]] = materialScratch[v];
+        }
+
+        for (uint32_t i = 0; i < part.indexCount; ++i) idx[i] = local[i] + part.firstVertex;
+    }
+
+    if (after) *after = analyzeCache(model.indices.data(), model.indices.size(), model.vertices.size());
+}
+
+void benchmarkDraw(const char *fileName, int instances, int frames) {
+    ObjModel raw;
+    if (!ObjLoader::loadModel(fileName, raw)) {
+        std::cerr << "Failed to load " << fileName << "\n";
+        return;
+    }
+    ObjModel optimized = raw;
+    CacheStats before, after;
+    optimizeModel(optimized, &before, &after);
+
+    const char *vs =
+        "#version 460\n"
+        "layout (location = 0) in vec3 VertexPosition;\n"
+        "layout (location = 1) in vec3 VertexNormal;\n"
+        "uniform mat4 uViewProj;\n"
+        "uniform int uGrid;\n"
+        "uniform float uSpacing;\n"
+        "out vec3 vNormal;\n"
+        "void main() {\n"
+        "    vec3 offset = vec3(gl_InstanceID % uGrid, 0.0, -(gl_InstanceID / uGrid)) * uSpacing;\n"
+        "    vNormal = VertexNormal;\n"
+        "    gl_Position = uViewProj * vec4(VertexPosition + offset, 1.0);\n"
+        "}\n";
+    const char *fs =
+        "#version 460\n"
+        "in vec3 vNormal;\n"
+        "layout (location = 0) out vec4 FragColor;\n"
+        "void main() {\n"
+        "    vec3 n = normalize(vNormal);\n"
+        "    float d = max(dot(n, normalize(vec3(0.3, 1.0, 0.5))), 0.0);\n"
+        "    float s = pow(max(dot(n, normalize(vec3(0.0, 0.7, 0.7))), 0.0), 64.0);\n"
+        "    FragColor = vec4(vec3(0.1 + d) + s, 1.0);\n"
+        "}\n";
+
+    GLSLProgram prog;
+    try {
+        prog.compileShader(std::string(vs), GLSLShader::VERTEX);
+        prog.compileShader(std::string(fs), GLSLShader::FRAGMENT);
+        prog.link();
+    }
+    catch (GLSLProgramException &e) {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+
+    struct Mesh { GLuint vao, vbo, ebo; };
+    auto upload = [](const ObjModel &m) {
+        Mesh mesh;
+        glGenVertexArrays(1, &mesh.vao);
+        glBindVertexArray(mesh.vao);
+        glGenBuffers(1, &mesh.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        glBufferData(GL_ARRAY_BUFFER, m.vertices.size() * sizeof(ObjVertex), m.vertices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, pos));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, normal));
+        glGenBuffers(1, &mesh.ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m.indices.size() * sizeof(uint32_t), m.indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        return mesh;
+    };
+    Mesh meshes[2] = { upload(raw), upload(optimized) };
+
+    // Offscreen target so the window's size and vsync don't matter
+    const int size = 1024;
+    GLuint fbo, color, depth;
+    glCreateFramebuffers(1, &fbo);
+    glCreateRenderbuffers(1, &color);
+    glNamedRenderbufferStorage(color, GL_RGBA8, size, size);
+    glCreateRenderbuffers(1, &depth);
+    glNamedRenderbufferStorage(depth, GL_DEPTH_COMPONENT24, size, size);
+    glNamedFramebufferRenderbuffer(fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glNamedFramebufferRenderbuffer(fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, size, size);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    // Instances a little closer than their width so the crowd overlaps
+    glm::vec3 lo = raw.vertices.empty() ? glm::vec3(0.0f) : raw.vertices[0].pos;
+    glm::vec3 hi = lo;
+    for (const ObjVertex &v : raw.vertices) { lo = glm::min(lo, v.pos); hi = glm::max(hi, v.pos); }
+    int grid = std::max(1, (int)std::ceil(std::sqrt((float)instances)));
+    float spacing = std::max(hi.x - lo.x, hi.z - lo.z) * 0.8f;
+    float extent = grid * spacing;
+
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, extent * 4.0f);
+    glm::mat4 viewMat = glm::lookAt(glm::vec3(extent * 0.5f, extent * 0.4f, extent * 0.6f),
+                                    glm::vec3(extent * 0.5f, 0.0f, -extent * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    prog.use();
+    prog.setUniform("uViewProj", proj * viewMat);
+    prog.setUniform("uGrid", grid);
+    prog.setUniform("uSpacing", spacing);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    double totalMs[2] = { 0.0, 0.0 };
+
+    // Alternate the two meshes frame by frame so clock changes hit both equally
+    for (int f = 0; f < frames + 4; ++f) {
+        for (int m = 0; m < 2; ++m) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            glBindVertexArray(meshes[m].vao);
+            glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)raw.indices.size(), GL_UNSIGNED_INT, nullptr, instances);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            if (f >= 4) totalMs[m] += double(ns) / 1.0e6;   // first frames are warm-up
+        }
+    }
+
+    printf("Mesh optimization: %s, %d instances, %zu triangles each\n",
+           fileName, instances, raw.indices.size() / 3);
+    printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (16-entry FIFO)\n",
+           before.acmr, after.acmr, before.atvr, after.atvr);
+    printf("  file order %8.3f ms/frame\n", totalMs[0] / frames);
+    printf("  optimized  %8.3f ms/frame (%+.1f%%)\n", totalMs[1] / frames,
+           100.0 * (totalMs[1] - totalMs[0]) / totalMs[0]);
+
+    // What the scene's packed vertices cost in precision
+    std::vector<PackedVertex> packed;
+    PackBounds bounds;
+    VertexPack::pack(optimized.vertices.data(), optimized.vertexMaterials.data(), optimized.vertices.size(),
+                     packed, bounds);
+    VertexPack::Error err = VertexPack::measure(optimized.vertices.data(), packed.data(), packed.size(), bounds);
+    printf("  vertex memory %zu -> %zu bytes packed; max error pos %.2g, normal %.2f deg, uv %.2g\n",
+           optimized.vertices.size() * (sizeof(ObjVertex) + sizeof(uint16_t)), packed.size() * sizeof(PackedVertex),
+           err.position, err.normalDegrees, err.uv);
+
+    glDeleteQueries(1, &query);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    glBindVertexArray(0);
+    for (Mesh &m : meshes) {
+        glDeleteVertexArrays(1, &m.vao);
+        glDeleteBuffers(1, &m.vbo);
+        glDeleteBuffers(1, &m.ebo);
+    }
+}
+
+} // namespace MeshOpt
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "objloader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Load-time triangle and vertex reordering for indexed meshes. Nothing
+// here changes what is drawn, only the order it is submitted in.
+namespace MeshOpt
+{
+    // Post-transform cache efficiency of an index buffer under a FIFO cache.
+    struct CacheStats {
+        float acmr = 0.0f;      // vertex shader runs per triangle (0.5 ideal, 3 worst)
+        float atvr = 0.0f;      // vertex shader runs per unique vertex (1 ideal)
+    };
+
+    CacheStats analyzeCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, int cacheSize = 16);
+
+    // Tipsify (Sander et al. 2007): fans around recently used vertices so
+    // consecutive triangles share cached vertices. In place.
+    void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount, int cacheSize = 16);
+
+    // Splits a cache-optimized index buffer into clusters and draws
+    // outward-facing clusters first, so they occlude the rest. Clusters only
+    // break where the ACMR stays within threshold of the input's.
+    void optimizeOverdraw(uint32_t *indices, size_t indexCount, const ObjVertex *vertices, size_t vertexCount,
+                          float threshold = 1.05f, int cacheSize = 16);
+
+    // Renumbers vertices in first-use order and rewrites the indices.
+    // remap[old] = new; move vertex arrays with it.
+    void optimizeVertexFetch(uint32_t *indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t> &remap);
+
+    // All three passes, run per part so material ranges stay contiguous.
+    void optimizeModel(ObjModel &model, CacheStats *before = nullptr, CacheStats *after = nullptr);
+
+    // Draws a large instanced grid of the model with and without
+    // optimizeModel and prints GPU time per frame for both, and what
+    // packing its vertices saves and costs in precision.
+    // Needs a current GL 4.6 context.
+    void benchmarkDraw(const char *fileName, int instances = 1024, int frames = 60);
+}
@@ -0,0 +1,294 @@
+#include "meshsimplify.h"
+
+#include "meshopt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Symmetric 4x4 matrix of plane equations plus the total plane weight,
+// so the error can be reported as an RMS distance.
+struct Quadric {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+    double weight;
+
+    void clear() { memset(this, 0, sizeof(*this)); }
+
+    void addPlane(const glm::dvec3 &n, double d, double w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+        a22 += w * n.z * n.z; a23 += w * n.z * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+    }
+
+    double eval(const glm::vec3 &p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+             + a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+             + a22 * z * z + 2.0 * a23 * z
+             + a33;
+    }
+};
+
+struct Collapse {
+    uint32_t from, to;
+    double cost;
+};
+
+inline bool samePosition(const glm::vec3 &a, const glm::vec3 &b) {
+    return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+}
+
+inline bool lessPosition(const glm::vec3 &a, const glm::vec3 &b) {
+    if (a.x != b.x) return a.x < b.x;
+    if (a.y != b.y) return a.y < b.y;
+    return a.z < b.z;
+}
+
+// Closeness of two vertices that share a position; used to pick which
+// attribute set of the surviving position a moved corner takes.
+inline float attributeDistance(const ObjVertex &a, const ObjVertex &b) {
+    glm::vec2 duv = a.uv - b.uv;
+    return (1.0f - glm::dot(a.normal, b.normal)) + glm::dot(duv, duv);
+}
+
+} // namespace
+
+namespace MeshSimplify {
+
+size_t simplify(uint32_t *out, const uint32_t *indices, size_t indexCount,
+                const ObjVertex *vertices, size_t vertexCount,
+                size_t targetIndexCount, float *outError) {
+    if (outError) *outError = 0.0f;
+    const size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0) return 0;
+
+    // Weld by exact position: group[v] is the topology vertex, members
+    // lists the attribute variants (wedges) of each group
+    std::vector<uint32_t> sorted(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v) sorted[v] = v;
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+        return lessPosition(vertices[a].pos, vertices[b].pos);
+    });
+
+    std::vector<uint32_t> group(vertexCount);
+    std::vector<uint32_t> memberOffsets;
+    std::vector<glm::vec3> position;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        if (i == 0 || !samePosition(vertices[sorted[i]].pos, vertices[sorted[i - 1]].pos)) {
+            memberOffsets.push_back(uint32_t(i));
+            position.push_back(vertices[sorted[i]].pos);
+        }
+        group[sorted[i]] = uint32_t(position.size() - 1);
+    }
+    const size_t groupCount = position.size();
+    memberOffsets.push_back(uint32_t(vertexCount));
+
+    // Triangles on groups; each corner also remembers its original vertex
+    std::vector<uint32_t> tris, corners;
+    for (size_t t = 0; t < triCount; ++t) {
+        uint32_t g0 = group[indices[t * 3]], g1 = group[indices[t * 3 + 1]], g2 = group[indices[t * 3 + 2]];
+        if (g0 == g1 || g1 == g2 || g0 == g2) continue;
+        tris.insert(tris.end(), { g0, g1, g2 });
+        corners.insert(corners.end(), { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] });
+    }
+    size_t liveTris = tris.size() / 3;
+    std::vector<char> dead(liveTris, 0);
+
+    std::vector<Quadric> quadric(groupCount);
+    for (Quadric &q : quadric) q.clear();
+    for (size_t t = 0; t < tris.size() / 3; ++t) {
+        glm::dvec3 p0(position[tris[t * 3]]), p1(position[tris[t * 3 + 1]]), p2(position[tris[t * 3 + 2]]);
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double len = glm::length(n);
+        if (len <= 0.0) continue;
+        n /= len;
+        double area = len * 0.5;
+        for (int c = 0; c < 3; ++c) quadric[tris[t * 3 + c]].addPlane(n, -glm::dot(n, p0), area);
+    }
+
+    // Lock positions on open or non-manifold edges
+    std::vector<char> locked(groupCount, 0);
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(tris.size());
+        for (size_t t = 0; t < tris.size() / 3; ++t) {
+            for (int e = 0; e < 3; ++e) {
+                uint64_t a = tris[t * 3 + e], b = tris[t * 3 + (e + 1) % 3];
+                edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i]) ++j;
+            if (j - i != 2) {
+                locked[edges[i] >> 32] = 1;
+                locked[edges[i] & 0xffffffffu] = 1;
+            }
+            i = j;
+        }
+    }
+
+    double maxError = 0.0;
+    std::vector<Collapse> candidates;
+    std::vector<uint32_t> triOffsets, triList;
+    std::vector<char> touched(groupCount);
+
+    while (liveTris * 3 > targetIndexCount) {
+        // Triangles around each group, rebuilt every pass
+        triOffsets.assign(groupCount + 1, 0);
+        for (size_t t = 0; t < dead.size(); ++t) {
+            if (dead[t]) continue;
+            for (int c = 0; c < 3; ++c) ++triOffsets[tris[t * 3 + c] + 1];
+        }
+        for (size_t g = 0; g < groupCount; ++g) triOffsets[g + 1] += triOffsets[g];
+        triList.resize(triOffsets[groupCount]);
+        {
+            std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+            for (size_t t = 0; t < dead.size(); ++t) {
+                if (dead[t]) continue;
+                for (int c = 0; c < 3; ++c) triList[fill[tris[t * 3 + c]]++] = uint32_t(t);
+            }
+        }
+
+        // Every edge in both directions, cheapest first
+        candidates.clear();
+        for (size_t t = 0; t < dead.size(); ++t) {
+            if (dead[t]) continue;
+            for (int e = 0; e < 3; ++e) {
+                uint32_t a = tris[t * 3 + e], b = tris[t * 3 + (e + 1) % 3];
+                Quadric q = quadric[a];
+                q.add(quadric[b]);
+                if (!locked[a]) candidates.push_back({ a, b, q.eval(position[b]) });
+                if (!locked[b]) candidates.push_back({ b, a, q.eval(position[a]) });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+        // Collapse greedily; anything a collapse touched waits for the next pass
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t collapsed = 0;
+        for (const Collapse &c : candidates) {
+            if (liveTris * 3 <= targetIndexCount) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            // Reject collapses that flip or squash a remaining triangle
+            bool flips = false;
+            for (uint32_t k = triOffsets[c.from]; k < triOffsets[c.from + 1] && !flips; ++k) {
+                const uint32_t *tri = &tris[triList[k] * 3];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) continue;
+
+                glm::vec3 p[3], q[3];
+                for (int i = 0; i < 3; ++i) {
+                    p[i] = position[tri[i]];
+                    q[i] = tri[i] == c.from ? position[c.to] : p[i];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                float lb = glm::length(before), la = glm::length(after);
+                flips = la <= 0.0f || (lb > 0.0f && glm::dot(before, after) < 0.2f * lb * la);
+            }
+            if (flips) continue;
+
+            for (uint32_t k = triOffsets[c.from]; k < triOffsets[c.from + 1]; ++k) {
+                uint32_t t = triList[k];
+                uint32_t *tri = &tris[t * 3];
+                for (int i = 0; i < 3; ++i) {
+                    touched[tri[i]] = 1;
+                    if (tri[i] == c.from) tri[i] = c.to;
+                }
+                if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+                    dead[t] = 1;
+                    --liveTris;
+                }
+            }
+
+            quadric[c.to].add(quadric[c.from]);
+            if (quadric[c.to].weight > 0.0)
+                maxError = std::max(maxError, c.cost / quadric[c.to].weight);
+            locked[c.from] = 1;     // gone; never a collapse source again
+            ++collapsed;
+        }
+        if (collapsed == 0) break;
+    }
+
+    // Resolve each corner to a real vertex: its own if the position
+    // survived, otherwise the surviving position's closest wedge
+    std::unordered_map<uint64_t, uint32_t> wedgeChoice;
+    size_t written = 0;
+    for (size_t t = 0; t < dead.size(); ++t) {
+        if (dead[t]) continue;
+        for (int c = 0; c < 3; ++c) {
+            uint32_t g = tris[t * 3 + c];
+            uint32_t v = corners[t * 3 + c];
+            if (group[v] != g) {
+                uint64_t key = (uint64_t(v) << 32) | g;
+                auto it = wedgeChoice.find(key);
+                if (it == wedgeChoice.end()) {
+                    uint32_t best = sorted[memberOffsets[g]];
+                    float bestDist = attributeDistance(vertices[v], vertices[best]);
+                    for (uint32_t m = memberOffsets[g] + 1; m < memberOffsets[g + 1]; ++m) {
+                        float d = attributeDistance(vertices[v], vertices[sorted[m]]);
+                        if (d < bestDist) { bestDist = d; best = sorted[m]; }
+                    }
+                    it = wedgeChoice.insert({ key, best }).first;
+                }
+                v = it->second;
+            }
+            out[written++] = v;
+        }
+    }
+
+    if (outError) *outError = float(std::sqrt(maxError));
+    return written;
+}
+
+void buildLods(ObjModel &model, const float *ratios, int count) {
+    model.lods.clear();
+    ObjModel::Lod full = { 0, (uint32_t)model.indices.size(), 0.0f };
+    model.lods.push_back(full);
+
+    std::vector<uint32_t> local, simplified;
+    for (int l = 0; l < count; ++l) {
+        ObjModel::Lod lod = { (uint32_t)model.indices.size(), 0, 0.0f };
+
+        for (const ObjModel::Part &part : model.parts) {
+            if (part.indexCount == 0) continue;
+
+            // Part-local so wedges are only ever picked from the part's own vertices
+            local.resize(part.indexCount);
+            for (uint32_t i = 0; i < part.indexCount; ++i)
+                local[i] = model.indices[part.firstIndex + i] - part.firstVertex;
+
+            size_t target = size_t(part.indexCount / 3 * ratios[l]) * 3;
+            simplified.resize(part.indexCount);
+            float error = 0.0f;
+            size_t n = simplify(simplified.data(), local.data(), local.size(),
+                                model.vertices.data() + part.firstVertex, part.vertexCount, target, &error);
+            MeshOpt::optimizeVertexCache(simplified.data(), n, part.vertexCount);
+
+            for (size_t i = 0; i < n; ++i) model.indices.push_back(simplified[i] + part.firstVertex);
+            lod.indexCount += (uint32_t)n;
+            lod.error = std::max(lod.error, error);
+        }
+
+        model.lods.push_back(lod);
+    }
+}
+
+} // namespace MeshSimplify
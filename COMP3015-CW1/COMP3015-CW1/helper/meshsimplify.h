@@ -0,0 +1,26 @@
+#pragma once
+
+#include "objloader.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Quadric error metric edge-collapse simplification (Garland & Heckbert).
+// Vertices are welded by position for the topology, so normal and UV
+// seams collapse together; open borders are kept in place so separately
+// simplified parts still meet without cracks.
+namespace MeshSimplify
+{
+    // Writes a triangle list of about targetIndexCount indices to out
+    // (which must hold indexCount) and returns how many were written.
+    // Output indices reference the input vertices. outError receives the
+    // largest RMS plane distance a collapse introduced.
+    size_t simplify(uint32_t *out, const uint32_t *indices, size_t indexCount,
+                    const ObjVertex *vertices, size_t vertexCount,
+                    size_t targetIndexCount, float *outError = nullptr);
+
+    // Appends one level per ratio (fraction of the full triangle count),
+    // each part simplified on its own, and fills model.lods with level 0
+    // first. Levels reuse the model's vertices.
+    void buildLods(ObjModel &model, const float *ratios, int count);
+}
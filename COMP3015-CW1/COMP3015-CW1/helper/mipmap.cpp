@@ -0,0 +1,347 @@
+#include "mipmap.h"
+
+#include "bcencode.h"
+#include "glslprogram.h"
+#include "../stb_image.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace {
+
+float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Source texels feeding one destination texel along an axis, with the
+// fraction of each that the destination covers
+struct Tap {
+    int first;
+    std::vector<float> weights;
+};
+
+std::vector<Tap> boxTaps(int srcSize, int dstSize) {
+    std::vector<Tap> taps(dstSize);
+    float ratio = float(srcSize) / float(dstSize);
+    for (int i = 0; i < dstSize; ++i) {
+        float lo = i * ratio, hi = (i + 1) * ratio;
+        int first = (int)std::floor(lo);
+        int last = std::min((int)std::ceil(hi), srcSize) - 1;
+        taps[i].first = first;
+        for (int s = first; s <= last; ++s) {
+            float overlap = std::min(hi, float(s + 1)) - std::max(lo, float(s));
+            taps[i].weights.push_back(overlap / ratio);
+        }
+    }
+    return taps;
+}
+
+// Premultiplied linear RGBA, 4 floats per texel
+void downsample(const std::vector<float> &src, int w, int h, std::vector<float> &dst, int dw, int dh) {
+    std::vector<Tap> tx = boxTaps(w, dw), ty = boxTaps(h, dh);
+
+    // Rows first, then columns
+    std::vector<float> rows(size_t(dw) * h * 4, 0.0f);
+    for (int y = 0; y < h; ++y) {
+        const float *in = &src[size_t(y) * w * 4];
+        float *out = &rows[size_t(y) * dw * 4];
+        for (int x = 0; x < dw; ++x) {
+            const Tap &t = tx[x];
+            for (size_t k = 0; k < t.weights.size(); ++k) {
+                const float *p = in + size_t(t.first + k) * 4;
+                for (int c = 0; c < 4; ++c) out[x * 4 + c] += p[c] * t.weights[k];
+            }
+        }
+    }
+
+    dst.assign(size_t(dw) * dh * 4, 0.0f);
+    for (int y = 0; y < dh; ++y) {
+        const Tap &t = ty[y];
+        float *out = &dst[size_t(y) * dw * 4];
+        for (size_t k = 0; k < t.weights.size(); ++k) {
+            const float *in = &rows[size_t(t.first + k) * dw * 4];
+            for (int i = 0; i < dw * 4; ++i) out[i] += in[i] * t.weights[k];
+        }
+    }
+}
+
+void encode(const std::vector<float> &src, std::vector<unsigned char> &out) {
+    out.resize(src.size());
+    for (size_t i = 0; i < src.size(); i += 4) {
+        float a = src[i + 3];
+        for (int c = 0; c < 3; ++c) {
+            float v = a > 0.0f ? src[i + c] / a : 0.0f;
+            out[i + c] = (unsigned char)(glm::clamp(linearToSrgb(v), 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        out[i + 3] = (unsigned char)(glm::clamp(a, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+// 8-bit sRGB to premultiplied linear floats
+void decode(const unsigned char *pixels, int width, int height, std::vector<float> &out) {
+    float toLinear[256];
+    for (int i = 0; i < 256; ++i) toLinear[i] = srgbToLinear(i / 255.0f);
+
+    out.resize(size_t(width) * height * 4);
+    for (size_t i = 0; i < out.size(); i += 4) {
+        float a = pixels[i + 3] / 255.0f;
+        for (int c = 0; c < 3; ++c) out[i + c] = toLinear[pixels[i + c]] * a;
+        out[i + 3] = a;
+    }
+}
+
+} // namespace
+
+namespace MipMap {
+
+int levelCount(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size >>= 1) ++levels;
+    return levels;
+}
+
+void generate(const unsigned char *pixels, int width, int height,
+              std::vector<std::vector<unsigned char>> &levels) {
+    levels.clear();
+    int count = levelCount(width, height);
+    if (count <= 1) return;
+
+    // Every level is filtered from the float copy of the one above, so
+    // rounding to 8 bits happens once per level rather than accumulating
+    std::vector<float> current, next;
+    decode(pixels, width, height, current);
+
+    int w = width, h = height;
+    levels.resize(count - 1);
+    for (int level = 1; level < count; ++level) {
+        int dw = std::max(1, w >> 1), dh = std::max(1, h >> 1);
+        downsample(current, w, h, next, dw, dh);
+        encode(next, levels[level - 1]);
+        current.swap(next);
+        w = dw;
+        h = dh;
+    }
+}
+
+void resize(const unsigned char *pixels, int width, int height, int newWidth, int newHeight,
+            std::vector<unsigned char> &out) {
+    // The box taps work in both directions: growing, each destination
+    // texel takes the one or two source texels it overlaps
+    std::vector<float> src, dst;
+    decode(pixels, width, height, src);
+    downsample(src, width, height, dst, newWidth, newHeight);
+    encode(dst, out);
+}
+
+void benchmarkSampling(const char *fileName, int frames) {
+    int w, h, n;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char *data = stbi_load(fileName, &w, &h, &n, 4);
+    if (!data) {
+        std::cerr << "Failed to load texture: " << fileName << std::endl;
+        return;
+    }
+
+    std::vector<std::vector<unsigned char>> mips;
+    generate(data, w, h, mips);
+    int levels = levelCount(w, h);
+
+    GLfloat maxAniso = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAniso);
+    float aniso = std::min(16.0f, maxAniso);
+
+    // Filtering on the RGBA8 texture, then the block formats with the best filtering
+    enum { BASE_ONLY, TRILINEAR, ANISOTROPIC };
+    GLuint samplers[3];
+    glCreateSamplers(3, samplers);
+    for (GLuint s : samplers) {
+        glSamplerParameteri(s, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glSamplerParameteri(s, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glSamplerParameteri(s, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glSamplerParameteri(samplers[BASE_ONLY], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(samplers[TRILINEAR], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameteri(samplers[ANISOTROPIC], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameterf(samplers[ANISOTROPIC], GL_TEXTURE_MAX_ANISOTROPY, aniso);
+
+    struct Case {
+        std::string label;
+        GLuint tex;
+        GLuint sampler;
+        int baseline;       // case the time is compared with
+        size_t bytes;
+        double encodeMs;
+        double psnr;
+        double totalMs;
+    };
+    std::vector<Case> cases;
+
+    GLuint rgba;
+    glCreateTextures(GL_TEXTURE_2D, 1, &rgba);
+    glTextureStorage2D(rgba, levels, GL_RGBA8, w, h);
+    glTextureSubImage2D(rgba, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    size_t rgbaBytes = size_t(w) * h * 4;
+    for (int level = 1; level < levels; ++level) {
+        glTextureSubImage2D(rgba, level, 0, 0, std::max(1, w >> level), std::max(1, h >> level),
+                            GL_RGBA, GL_UNSIGNED_BYTE, mips[level - 1].data());
+        rgbaBytes += mips[level - 1].size();
+    }
+    char anisoLabel[32];
+    snprintf(anisoLabel, sizeof(anisoLabel), "RGBA8 trilinear %.0fx AF", aniso);
+    cases.push_back({ "RGBA8 base level only", rgba, samplers[BASE_ONLY], -1, size_t(w) * h * 4, 0.0, 0.0, 0.0 });
+    cases.push_back({ "RGBA8 trilinear", rgba, samplers[TRILINEAR], 0, rgbaBytes, 0.0, 0.0, 0.0 });
+    cases.push_back({ anisoLabel, rgba, samplers[ANISOTROPIC], 0, rgbaBytes, 0.0, 0.0, 0.0 });
+
+    const BC::Format formats[] = { BC::BC1, BC::BC3, BC::BC7 };
+    std::vector<unsigned char> decoded(size_t(w) * h * 4);
+    for (BC::Format format : formats) {
+        if (!BC::supported(format)) continue;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<std::vector<unsigned char>> blocks(levels);
+        BC::encode(data, w, h, format, blocks[0]);
+        for (int level = 1; level < levels; ++level)
+            BC::encode(mips[level - 1].data(), std::max(1, w >> level), std::max(1, h >> level), format, blocks[level]);
+        double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+        GLuint tex;
+        size_t bytes = 0;
+        glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+        glTextureStorage2D(tex, levels, BC::glFormat(format), w, h);
+        for (int level = 0; level < levels; ++level) {
+            glCompressedTextureSubImage2D(tex, level, 0, 0, std::max(1, w >> level), std::max(1, h >> level),
+                                          BC::glFormat(format), (GLsizei)blocks[level].size(), blocks[level].data());
+            bytes += blocks[level].size();
+        }
+
+        // Quality of the top level as the GPU decodes it, colour channels only
+        glGetTextureImage(tex, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLsizei)decoded.size(), decoded.data());
+        double sse = 0.0;
+        for (size_t i = 0; i < decoded.size(); ++i) {
+            if ((i & 3) == 3) continue;
+            double d = double(decoded[i]) - double(data[i]);
+            sse += d * d;
+        }
+        double mse = sse / (double(w) * h * 3);
+        double psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+
+        cases.push_back({ std::string(BC::name(format)) + " trilinear AF", tex, samplers[ANISOTROPIC], 2,
+                          bytes, encodeMs, psnr, 0.0 });
+    }
+    stbi_image_free(data);
+
+    // Ground plane from gl_VertexID, tiled at the scene's 0.5 repeats per unit
+    const char *vs =
+        "#version 460\n"
+        "uniform mat4 uViewProj;\n"
+        "out vec2 vUV;\n"
+        "void main() {\n"
+        "    const vec2 corners[4] = vec2[](vec2(-1, -1), vec2(1, -1), vec2(-1, 1), vec2(1, 1));\n"
+        "    vec2 p = corners[gl_VertexID] * 200.0;\n"
+        "    vUV = p * 0.5;\n"
+        "    gl_Position = uViewProj * vec4(p.x, 0.0, p.y, 1.0);\n"
+        "}\n";
+    const char *fs =
+        "#version 460\n"
+        "in vec2 vUV;\n"
+        "uniform sampler2D uTex;\n"
+        "layout (location = 0) out vec4 FragColor;\n"
+        "void main() {\n"
+        "    FragColor = texture(uTex, vUV);\n"
+        "}\n";
+
+    GLSLProgram prog;
+    try {
+        prog.compileShader(std::string(vs), GLSLShader::VERTEX);
+        prog.compileShader(std::string(fs), GLSLShader::FRAGMENT);
+        prog.link();
+    }
+    catch (GLSLProgramException &e) {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+
+    // Offscreen target so the window's size and vsync don't matter
+    const int size = 1024;
+    GLuint fbo, color;
+    glCreateFramebuffers(1, &fbo);
+    glCreateRenderbuffers(1, &color);
+    glNamedRenderbufferStorage(color, GL_RGBA8, size, size);
+    glNamedFramebufferRenderbuffer(fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, size, size);
+    glDisable(GL_DEPTH_TEST);
+
+    // Standing eye height, looking just below the horizon: most of the
+    // frame is floor at a grazing angle, the case mips and anisotropy are for
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 400.0f);
+    glm::mat4 viewMat = glm::lookAt(glm::vec3(0.0f, 1.7f, 0.0f), glm::vec3(0.0f, 1.2f, -4.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    prog.use();
+    prog.setUniform("uViewProj", proj * viewMat);
+    prog.setUniform("uTex", 0);
+
+    GLuint vao;
+    glCreateVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    // Several layers per frame so the time is well above timer resolution
+    const int layers = 8;
+    GLuint query;
+    glGenQueries(1, &query);
+
+    // Alternate the cases frame by frame so clock changes hit all equally
+    for (int f = 0; f < frames + 4; ++f) {
+        for (Case &c : cases) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            glBindTextureUnit(0, c.tex);
+            glBindSampler(0, c.sampler);
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int i = 0; i < layers; ++i) glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            if (f >= 4) c.totalMs += double(ns) / 1.0e6;   // first frames are warm-up
+        }
+    }
+
+    printf("Texture sampling: %s, %dx%d, %d levels, floor view %dx%d x %d layers\n",
+           fileName, w, h, levels, size, size, layers);
+    for (const Case &c : cases) {
+        printf("  %-24s %8.3f ms/frame", c.label.c_str(), c.totalMs / frames);
+        if (c.baseline >= 0) {
+            const Case &b = cases[c.baseline];
+            printf(" (%+6.1f%% vs %s)", 100.0 * (c.totalMs - b.totalMs) / b.totalMs, b.label.c_str());
+        }
+        printf(", %.2f MB", c.bytes / 1048576.0);
+        if (c.encodeMs > 0.0) printf(", PSNR %.1f dB, encoded in %.0f ms", c.psnr, c.encodeMs);
+        printf("\n");
+    }
+
+    glDeleteQueries(1, &query);
+    glBindSampler(0, 0);
+    glDeleteSamplers(3, samplers);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vao);
+    for (const Case &c : cases) {
+        if (c.tex != rgba) glDeleteTextures(1, &c.tex);
+    }
+    glDeleteTextures(1, &rgba);
+    glEnable(GL_DEPTH_TEST);
+}
+
+} // namespace MipMap
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+// Mip chains for RGBA8 textures, built on the CPU so they can be made on
+// the loader thread next to the decode.
+//
+// Colour is treated as sRGB: it is decoded to linear light, filtered,
+// and encoded again, so dark/bright detail doesn't average to a darker
+// mid-tone the way filtering the stored bytes does. Colour is weighted
+// by alpha. Each level is an area-weighted box of the one above, which
+// stays exact for odd sizes where a 2x2 box would drop a row or column.
+namespace MipMap
+{
+    // Levels down to 1x1, including the base.
+    int levelCount(int width, int height);
+
+    // Fills levels with 1 .. levelCount - 1; level i is
+    // max(1, width >> i) x max(1, height >> i).
+    void generate(const unsigned char *pixels, int width, int height,
+                  std::vector<std::vector<unsigned char>> &levels);
+
+    // Resamples to newWidth x newHeight with the same area-weighted filter,
+    // up or down; used to bring images to a texture array's layer size.
+    void resize(const unsigned char *pixels, int width, int height, int newWidth, int newHeight,
+                std::vector<unsigned char> &out);
+
+    // Draws a floor stretching to the horizon, tiled like the scene's,
+    // with the base level only, trilinear, and trilinear + anisotropic
+    // sampling, then with the chain block-compressed to each BC format.
+    // Prints GPU time per frame, memory and, for BC, PSNR and encode time.
+    // Needs a current GL 4.6 context.
+    void benchmarkSampling(const char *fileName, int frames = 60);
+}
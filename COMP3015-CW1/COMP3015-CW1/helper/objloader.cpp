@@ -0,0 +1,902 @@
+#include "objloader.h"
+
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && isSpace(*p)) ++p;
+    return p;
+}
+
+inline const char *skipLine(const char *p, const char *end) {
+    while (p < end && *p != '\n') ++p;
+    return p;
+}
+
+inline const char *skipToken(const char *p, const char *end) {
+    while (p < end && !isSpace(*p) && *p != '\n') ++p;
+    return p;
+}
+
+inline bool tokenIs(const char *p, const char *tokEnd, const char *word) {
+    size_t n = strlen(word);
+    return size_t(tokEnd - p) == n && memcmp(p, word, n) == 0;
+}
+
+// Rest of the line with surrounding whitespace removed (file names may contain spaces)
+inline std::string restOfLine(const char *p, const char *end) {
+    p = skipSpaces(p, end);
+    const char *e = skipLine(p, end);
+    while (e > p && isSpace(e[-1])) --e;
+    return std::string(p, e);
+}
+
+inline std::string directoryOf(const char *fileName) {
+    std::string path(fileName);
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// Scans an integer at [first, last). Returns the position after the number,
+// or first if no digits were found (same contract as std::from_chars).
+// Digit runs past INT_MAX saturate to +-INT_MAX: such a face index is out
+// of range and dropped, and such an exponent still over- or underflows.
+const char *parseInt(const char *first, const char *last, int &value) {
+    const char *p = first;
+    bool neg = false;
+    if (p < last && (*p == '-' || *p == '+')) { neg = (*p == '-'); ++p; }
+    if (p == last || !isDigit(*p)) return first;
+
+    int v = 0;
+    while (p < last && isDigit(*p)) {
+        const int digit = *p - '0';
+        v = (v > (INT_MAX - digit) / 10) ? INT_MAX : v * 10 + digit;
+        ++p;
+    }
+    value = neg ? -v : v;
+    return p;
+}
+
+// Scans a decimal float at [first, last), same contract as parseInt.
+// Values with at most 24 bits of mantissa and a small exponent are built with
+// a single correctly rounded multiply or divide (exact powers of ten fit in a
+// float up to 1e10). Everything else goes through strtof on a stack copy, so
+// results match the stream parser bit for bit.
+const char *parseFloat(const char *first, const char *last, float &value) {
+    static const float pow10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    const char *p = first;
+    bool neg = false;
+    if (p < last && (*p == '-' || *p == '+')) { neg = (*p == '-'); ++p; }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exp10 = 0;
+    bool any = false;
+
+    while (p < last && isDigit(*p)) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            if (mantissa != 0) ++digits;
+        } else {
+            ++exp10;
+        }
+        any = true;
+        ++p;
+    }
+    if (p < last && *p == '.') {
+        ++p;
+        while (p < last && isDigit(*p)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                if (mantissa != 0) ++digits;
+                --exp10;
+            }
+            any = true;
+            ++p;
+        }
+    }
+    if (!any) return first;
+
+    if (p < last && (*p == 'e' || *p == 'E')) {
+        int e = 0;
+        const char *q = parseInt(p + 1, last, e);
+        if (q != p + 1) {
+            exp10 = (int)std::max<int64_t>(-INT_MAX, std::min<int64_t>(INT_MAX, int64_t(exp10) + e));
+            p = q;
+        }
+    }
+
+    if (mantissa <= (uint64_t(1) << 24) && exp10 >= -10 && exp10 <= 10) {
+        float f = float(mantissa);
+        f = (exp10 < 0) ? f / pow10[-exp10] : f * pow10[exp10];
+        value = neg ? -f : f;
+        return p;
+    }
+
+    char buf[64];
+    size_t len = size_t(p - first);
+    if (len < sizeof(buf)) {
+        for (size_t i = 0; i < len; ++i) buf[i] = first[i];
+        buf[len] = '\0';
+        value = strtof(buf, nullptr);
+    } else {
+        value = strtof(std::string(first, p).c_str(), nullptr);
+    }
+    return p;
+}
+
+int fixIndex(int idx, int size) {
+    if (idx > 0) return idx - 1;
+    if (idx < 0) return size + idx;
+    return -1;
+}
+
+// One face corner: v, v/vt, v//vn or v/vt/vn
+const char *parseCorner(const char *p, const char *end, int &vi, int &ti, int &ni) {
+    vi = ti = ni = 0;
+    const char *q = parseInt(p, end, vi);
+    if (q == p) return p;
+    if (q < end && *q == '/') {
+        ++q;
+        q = parseInt(q, end, ti);
+        if (q < end && *q == '/') {
+            ++q;
+            q = parseInt(q, end, ni);
+        }
+    }
+    return q;
+}
+
+// Line keywords the loader cares about.
+enum LineType { LINE_OTHER, LINE_V, LINE_VT, LINE_VN, LINE_F, LINE_USEMTL, LINE_MTLLIB };
+
+LineType classify(const char *p, const char *tokEnd) {
+    size_t n = size_t(tokEnd - p);
+    if (n == 1) {
+        if (p[0] == 'v') return LINE_V;
+        if (p[0] == 'f') return LINE_F;
+    }
+    else if (n == 2 && p[0] == 'v') {
+        if (p[1] == 't') return LINE_VT;
+        if (p[1] == 'n') return LINE_VN;
+    }
+    else if (n == 6 && p[0] == 'u' && std::string::traits_type::compare(p, "usemtl", 6) == 0) {
+        return LINE_USEMTL;
+    }
+    else if (n == 6 && p[0] == 'm' && std::string::traits_type::compare(p, "mtllib", 6) == 0) {
+        return LINE_MTLLIB;
+    }
+    return LINE_OTHER;
+}
+
+const char *parseVec3(const char *p, const char *end, glm::vec3 &v) {
+    v = glm::vec3(0.0f);
+    p = parseFloat(skipSpaces(p, end), end, v.x);
+    p = parseFloat(skipSpaces(p, end), end, v.y);
+    p = parseFloat(skipSpaces(p, end), end, v.z);
+    return p;
+}
+
+const char *parseTexcoord(const char *p, const char *end, glm::vec2 &t) {
+    t = glm::vec2(0.0f);
+    p = parseFloat(skipSpaces(p, end), end, t.x);
+    p = parseFloat(skipSpaces(p, end), end, t.y);
+    t.y = 1.0f - t.y;
+    return p;
+}
+
+// Raw OBJ indices of one face corner (1-based, negative = relative, 0 = absent)
+struct RawCorner { int v, t, n; };
+
+// Reads the corners of an f line into out, replacing its contents.
+const char *parseFace(const char *p, const char *end, std::vector<RawCorner> &out) {
+    out.clear();
+    while (true) {
+        p = skipSpaces(p, end);
+        if (p >= end || *p == '\n') break;
+
+        RawCorner c;
+        const char *q = parseCorner(p, end, c.v, c.t, c.n);
+        if (q == p) break;
+        p = skipToken(q, end);
+        out.push_back(c);
+    }
+    return p;
+}
+
+// Resolves a polygon against the attribute arrays as they stood when the
+// face was read (np/nt/nn entries) and appends its triangle fan to out:
+// (first, prev, cur) for each corner after the second.
+void emitPolygon(const RawCorner *corners, size_t count,
+                 const std::vector<glm::vec3> &positions,
+                 const std::vector<glm::vec2> &texcoords,
+                 const std::vector<glm::vec3> &normals,
+                 int np, int nt, int nn, std::vector<ObjVertex> &out) {
+    ObjVertex first{}, prev{};
+    bool firstOk = false, prevOk = false;
+
+    for (size_t corner = 0; corner < count; ++corner) {
+        const RawCorner &c = corners[corner];
+        int pi = fixIndex(c.v, np);
+        int t = fixIndex(c.t, nt);
+        int n = fixIndex(c.n, nn);
+
+        ObjVertex gv{};
+        bool ok = (pi >= 0 && pi < np);
+        if (ok) {
+            gv.pos = positions[pi];
+            gv.uv = (t >= 0 && t < nt) ? texcoords[t] : glm::vec2(0.0f);
+            gv.normal = (n >= 0 && n < nn) ? normals[n] : glm::vec3(0, 1, 0);
+        }
+
+        if (corner == 0) { first = gv; firstOk = ok; }
+        else if (corner >= 2 && firstOk && prevOk && ok) {
+            out.push_back(first);
+            out.push_back(prev);
+            out.push_back(gv);
+        }
+        prev = gv;
+        prevOk = ok;
+    }
+}
+
+// Everything one chunk of the file contributes. Attribute arrays are local
+// to the chunk; faces keep their raw indices plus the local attribute counts
+// at the point they were read, so negative indices can be resolved once the
+// chunk's global base offsets are known.
+struct ObjChunk {
+    const char *begin;
+    const char *end;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+
+    struct Face {
+        uint32_t firstCorner;
+        uint32_t cornerCount;
+        int np, nt, nn;
+    };
+    std::vector<RawCorner> corners;
+    std::vector<Face> faces;
+
+    // usemtl lines: (index of the next face, material name)
+    std::vector<std::pair<size_t, std::string>> mtlChanges;
+
+    int basePos = 0, baseTex = 0, baseNorm = 0;
+    std::string startMtl;
+
+    // Resolved triangles per material, in order of first use
+    std::vector<std::pair<std::string, std::vector<ObjVertex>>> streams;
+};
+
+void parseChunk(ObjChunk &chunk) {
+    const char *p = chunk.begin;
+    const char *end = chunk.end;
+    std::vector<RawCorner> face;
+
+    while (p < end) {
+        p = skipSpaces(p, end);
+        const char *tokEnd = skipToken(p, end);
+        LineType type = classify(p, tokEnd);
+        p = tokEnd;
+
+        switch (type) {
+        case LINE_V: {
+            glm::vec3 v;
+            p = parseVec3(p, end, v);
+            chunk.positions.push_back(v);
+            break;
+        }
+        case LINE_VT: {
+            glm::vec2 t;
+            p = parseTexcoord(p, end, t);
+            chunk.texcoords.push_back(t);
+            break;
+        }
+        case LINE_VN: {
+            glm::vec3 n;
+            p = parseVec3(p, end, n);
+            chunk.normals.push_back(n);
+            break;
+        }
+        case LINE_USEMTL: {
+            p = skipSpaces(p, end);
+            const char *nameEnd = skipToken(p, end);
+            chunk.mtlChanges.push_back(std::make_pair(chunk.faces.size(),
+                nameEnd != p ? std::string(p, nameEnd) : std::string("default")));
+            p = nameEnd;
+            break;
+        }
+        case LINE_F: {
+            p = parseFace(p, end, face);
+            ObjChunk::Face f;
+            f.firstCorner = (uint32_t)chunk.corners.size();
+            f.cornerCount = (uint32_t)face.size();
+            f.np = (int)chunk.positions.size();
+            f.nt = (int)chunk.texcoords.size();
+            f.nn = (int)chunk.normals.size();
+            chunk.corners.insert(chunk.corners.end(), face.begin(), face.end());
+            chunk.faces.push_back(f);
+            break;
+        }
+        default:
+            break;
+        }
+
+        p = skipLine(p, end);
+        if (p < end) ++p;
+    }
+}
+
+void resolveChunk(ObjChunk &chunk,
+                  const std::vector<glm::vec3> &positions,
+                  const std::vector<glm::vec2> &texcoords,
+                  const std::vector<glm::vec3> &normals) {
+    std::string mtlName = chunk.startMtl;
+    std::vector<ObjVertex> *current = nullptr;
+    size_t nextChange = 0;
+
+    for (size_t i = 0; i < chunk.faces.size(); ++i) {
+        while (nextChange < chunk.mtlChanges.size() && chunk.mtlChanges[nextChange].first == i) {
+            mtlName = chunk.mtlChanges[nextChange].second;
+            current = nullptr;
+            ++nextChange;
+        }
+
+        if (!current) {
+            for (auto &s : chunk.streams) {
+                if (s.first == mtlName) { current = &s.second; break; }
+            }
+            if (!current) {
+                chunk.streams.push_back(std::make_pair(mtlName, std::vector<ObjVertex>()));
+                current = &chunk.streams.back().second;
+            }
+        }
+
+        const ObjChunk::Face &f = chunk.faces[i];
+        emitPolygon(&chunk.corners[f.firstCorner], f.cornerCount, positions, texcoords, normals,
+                    chunk.basePos + f.np, chunk.baseTex + f.nt, chunk.baseNorm + f.nn, *current);
+    }
+}
+
+// Runs fn(0..count-1), one thread per index, the first on the calling thread.
+template <typename Fn>
+void forEachParallel(size_t count, Fn fn) {
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < count; ++i) workers.emplace_back(fn, i);
+    if (count > 0) fn(0);
+    for (auto &t : workers) t.join();
+}
+
+} // namespace
+
+namespace ObjLoader {
+
+bool loadByMaterial(const char *fileName, MaterialStreams &outByMtl) {
+    MappedFile file;
+    if (!file.open(fileName)) {
+        std::cerr << "Failed to open OBJ: " << fileName << "\n";
+        return false;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+
+    // Rough reservation from file size keeps the attribute arrays from
+    // regrowing on big models (~30 bytes per v/vt/vn record).
+    positions.reserve(file.size() / 96);
+    texcoords.reserve(file.size() / 96);
+    normals.reserve(file.size() / 96);
+
+    std::string mtlName = "default";
+    std::vector<ObjVertex> *current = nullptr;
+    std::vector<RawCorner> face;
+
+    const char *p = file.data();
+    const char *end = p + file.size();
+
+    while (p < end) {
+        p = skipSpaces(p, end);
+        const char *tokEnd = skipToken(p, end);
+        LineType type = classify(p, tokEnd);
+        p = tokEnd;
+
+        switch (type) {
+        case LINE_V: {
+            glm::vec3 v;
+            p = parseVec3(p, end, v);
+            positions.push_back(v);
+            break;
+        }
+        case LINE_VT: {
+            glm::vec2 t;
+            p = parseTexcoord(p, end, t);
+            texcoords.push_back(t);
+            break;
+        }
+        case LINE_VN: {
+            glm::vec3 n;
+            p = parseVec3(p, end, n);
+            normals.push_back(n);
+            break;
+        }
+        case LINE_USEMTL: {
+            p = skipSpaces(p, end);
+            const char *nameEnd = skipToken(p, end);
+            if (nameEnd != p) mtlName.assign(p, nameEnd);
+            else mtlName = "default";
+            current = nullptr;
+            p = nameEnd;
+            break;
+        }
+        case LINE_F: {
+            if (!current) current = &outByMtl[mtlName];
+
+            p = parseFace(p, end, face);
+            emitPolygon(face.data(), face.size(), positions, texcoords, normals,
+                        (int)positions.size(), (int)texcoords.size(), (int)normals.size(), *current);
+            break;
+        }
+        default:
+            break;
+        }
+
+        p = skipLine(p, end);
+        if (p < end) ++p;
+    }
+
+    return true;
+}
+
+bool loadByMaterialParallel(const char *fileName, MaterialStreams &outByMtl, unsigned threadCount,
+                            size_t minChunkBytes) {
+    MappedFile file;
+    if (!file.open(fileName)) {
+        std::cerr << "Failed to open OBJ: " << fileName << "\n";
+        return false;
+    }
+
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkCount = std::min<size_t>(threadCount, std::max<size_t>(1, file.size() / std::max<size_t>(1, minChunkBytes)));
+    if (chunkCount <= 1) {
+        file.close();
+        return loadByMaterial(fileName, outByMtl);
+    }
+
+    // Line-aligned split: each boundary moves forward past the next newline
+    const char *data = file.data();
+    const char *end = data + file.size();
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char *start = data;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const char *stop = (i + 1 == chunkCount) ? end : data + file.size() * (i + 1) / chunkCount;
+        if (stop < start) stop = start;
+        stop = skipLine(stop, end);
+        if (stop < end) ++stop;
+        chunks[i].begin = start;
+        chunks[i].end = stop;
+        start = stop;
+    }
+
+    forEachParallel(chunkCount, [&](size_t i) { parseChunk(chunks[i]); });
+
+    // Global attribute offsets and the material each chunk starts in
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    std::string mtlName = "default";
+    for (ObjChunk &c : chunks) {
+        c.basePos = (int)positions.size();
+        c.baseTex = (int)texcoords.size();
+        c.baseNorm = (int)normals.size();
+        c.startMtl = mtlName;
+        if (!c.mtlChanges.empty()) mtlName = c.mtlChanges.back().second;
+
+        positions.insert(positions.end(), c.positions.begin(), c.positions.end());
+        texcoords.insert(texcoords.end(), c.texcoords.begin(), c.texcoords.end());
+        normals.insert(normals.end(), c.normals.begin(), c.normals.end());
+        std::vector<glm::vec3>().swap(c.positions);
+        std::vector<glm::vec2>().swap(c.texcoords);
+        std::vector<glm::vec3>().swap(c.normals);
+    }
+
+    forEachParallel(chunkCount, [&](size_t i) {
+        resolveChunk(chunks[i], positions, texcoords, normals);
+    });
+
+    // Concatenate per material in file order
+    for (ObjChunk &c : chunks) {
+        for (auto &s : c.streams) {
+            std::vector<ObjVertex> &dst = outByMtl[s.first];
+            if (dst.empty()) dst.swap(s.second);
+            else dst.insert(dst.end(), s.second.begin(), s.second.end());
+        }
+    }
+    return true;
+}
+
+std::string findMtlLib(const char *objFileName) {
+    MappedFile file;
+    if (!file.open(objFileName)) return std::string();
+
+    const char *p = file.data();
+    const char *end = p + file.size();
+    while (p < end) {
+        p = skipSpaces(p, end);
+        const char *tokEnd = skipToken(p, end);
+        if (classify(p, tokEnd) == LINE_MTLLIB) {
+            std::string name = restOfLine(tokEnd, end);
+            if (!name.empty()) return directoryOf(objFileName) + name;
+        }
+        p = skipLine(tokEnd, end);
+        if (p < end) ++p;
+    }
+    return std::string();
+}
+
+bool loadMtl(const char *fileName, std::vector<ObjMaterial> &out) {
+    MappedFile file;
+    if (!file.open(fileName)) {
+        std::cerr << "Failed to open MTL: " << fileName << "\n";
+        return false;
+    }
+
+    const std::string dir = directoryOf(fileName);
+    ObjMaterial *current = nullptr;
+
+    const char *p = file.data();
+    const char *end = p + file.size();
+    while (p < end) {
+        p = skipSpaces(p, end);
+        const char *tokEnd = skipToken(p, end);
+        const char *tok = p;
+        p = tokEnd;
+
+        if (tokenIs(tok, tokEnd, "newmtl")) {
+            out.push_back(ObjMaterial());
+            current = &out.back();
+            p = skipSpaces(p, end);
+            const char *nameEnd = skipToken(p, end);
+            current->name.assign(p, nameEnd);   // single token, as usemtl reads it
+            p = nameEnd;
+        }
+        else if (current) {
+            if (tokenIs(tok, tokEnd, "Kd")) p = parseVec3(p, end, current->kd);
+            else if (tokenIs(tok, tokEnd, "Ks")) p = parseVec3(p, end, current->ks);
+            else if (tokenIs(tok, tokEnd, "Ns")) p = parseFloat(skipSpaces(p, end), end, current->ns);
+            else if (tokenIs(tok, tokEnd, "d")) p = parseFloat(skipSpaces(p, end), end, current->d);
+            else if (tokenIs(tok, tokEnd, "Tr")) {
+                float tr = 0.0f;
+                p = parseFloat(skipSpaces(p, end), end, tr);
+                current->d = 1.0f - tr;
+            }
+            else if (tokenIs(tok, tokEnd, "map_Kd")) {
+                // Options (-bm 1 ...) may precede the file name; take the last token
+                std::string rest = restOfLine(p, end);
+                size_t space = rest.find_last_of(" \t");
+                if (!rest.empty()) current->mapKd = dir + (space == std::string::npos ? rest : rest.substr(space + 1));
+            }
+        }
+
+        p = skipLine(p, end);
+        if (p < end) ++p;
+    }
+    return true;
+}
+
+bool loadModel(const char *fileName, ObjModel &out) {
+    IndexedMaterials byMtl;
+    if (!loadIndexedByMaterial(fileName, byMtl)) return false;
+
+    out = ObjModel();
+    std::string mtlLib = findMtlLib(fileName);
+    if (!mtlLib.empty()) loadMtl(mtlLib.c_str(), out.materials);
+
+    // Append defaults for materials the MTL does not define
+    std::vector<std::string> names;
+    for (auto &kv : byMtl) names.push_back(kv.first);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names) {
+        bool known = false;
+        for (const ObjMaterial &m : out.materials) known = known || m.name == name;
+        if (!known) {
+            ObjMaterial m;
+            m.name = name;
+            out.materials.push_back(m);
+        }
+    }
+
+    for (uint32_t mi = 0; mi < (uint32_t)out.materials.size(); ++mi) {
+        auto it = byMtl.find(out.materials[mi].name);
+        if (it == byMtl.end() || it->second.indices.empty()) continue;
+        const IndexedMesh &mesh = it->second;
+
+        ObjModel::Part part;
+        part.material = mi;
+        part.firstIndex = (uint32_t)out.indices.size();
+        part.indexCount = (uint32_t)mesh.indices.size();
+        part.firstVertex = (uint32_t)out.vertices.size();
+        part.vertexCount = (uint32_t)mesh.vertices.size();
+        out.parts.push_back(part);
+
+        out.vertices.insert(out.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        out.vertexMaterials.insert(out.vertexMaterials.end(), mesh.vertices.size(), (uint16_t)mi);
+        for (uint32_t idx : mesh.indices) out.indices.push_back(idx + part.firstVertex);
+    }
+    return true;
+}
+
+ObjModelView viewOf(const ObjModel &model) {
+    ObjModelView v;
+    v.materials = model.materials.data();
+    v.materialCount = model.materials.size();
+    v.parts = model.parts.data();
+    v.partCount = model.parts.size();
+    v.vertices = model.vertices.data();
+    v.vertexMaterials = model.vertexMaterials.data();
+    v.vertexCount = model.vertices.size();
+    v.indices = model.indices.data();
+    v.indexCount = model.indices.size();
+    v.indexSize = 4;
+    v.lods = model.lods.data();
+    v.lodCount = model.lods.size();
+    return v;
+}
+
+bool loadIndexedByMaterial(const char *fileName, IndexedMaterials &outByMtl) {
+    MaterialStreams streams;
+    if (!loadByMaterialParallel(fileName, streams)) return false;
+
+    for (auto &kv : streams) {
+        if (kv.second.empty()) continue;
+        weld(kv.second, outByMtl[kv.first]);
+    }
+    return true;
+}
+
+static uint32_t hashVertex(const ObjVertex &v) {
+    uint32_t words[sizeof(ObjVertex) / 4];
+    memcpy(words, &v, sizeof(ObjVertex));
+
+    uint32_t h = 2166136261u;
+    for (uint32_t w : words) {
+        h ^= w;
+        h *= 16777619u;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+void weld(const std::vector<ObjVertex> &soup, IndexedMesh &out) {
+    out.vertices.clear();
+    out.indices.resize(soup.size());
+
+    // Open addressing, kept at most half full
+    size_t capacity = 64;
+    while (capacity < soup.size() * 2) capacity <<= 1;
+    const size_t mask = capacity - 1;
+    std::vector<uint32_t> table(capacity, UINT32_MAX);
+
+    for (size_t i = 0; i < soup.size(); ++i) {
+        const ObjVertex &v = soup[i];
+        size_t slot = hashVertex(v) & mask;
+
+        while (true) {
+            uint32_t idx = table[slot];
+            if (idx == UINT32_MAX) {
+                idx = (uint32_t)out.vertices.size();
+                out.vertices.push_back(v);
+                table[slot] = idx;
+                out.indices[i] = idx;
+                break;
+            }
+            if (memcmp(&out.vertices[idx], &v, sizeof(ObjVertex)) == 0) {
+                out.indices[i] = idx;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+}
+
+size_t countCacheMisses(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize) {
+    // Each vertex remembers when it entered the FIFO; it is still cached
+    // while fewer than cacheSize misses have happened since.
+    std::vector<size_t> entered(vertexCount, SIZE_MAX);
+    size_t misses = 0;
+
+    for (uint32_t idx : indices) {
+        if (entered[idx] != SIZE_MAX && misses - entered[idx] < (size_t)cacheSize) continue;
+        entered[idx] = misses;
+        ++misses;
+    }
+    return misses;
+}
+
+static int StreamFixIndex(int idx, int size) {
+    if (idx > 0) return idx - 1;
+    if (idx < 0) return size + idx;
+    return -1;
+}
+
+static bool ParseVVTVN(const std::string& s, int& vi, int& ti, int& ni) {
+    vi = ti = ni = 0;
+
+    size_t p1 = s.find('/');
+    if (p1 == std::string::npos) {
+        vi = std::stoi(s);
+        return true;
+    }
+    size_t p2 = s.find('/', p1 + 1);
+    if (p2 == std::string::npos) return false;
+
+    vi = std::stoi(s.substr(0, p1));
+    std::string t = s.substr(p1 + 1, p2 - (p1 + 1));
+    std::string n = s.substr(p2 + 1);
+
+    if (!t.empty()) ti = std::stoi(t);
+    if (!n.empty()) ni = std::stoi(n);
+    return true;
+}
+
+bool loadByMaterialStream(const char *fileName, MaterialStreams &outByMtl) {
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open OBJ: " << fileName << "\n";
+        return false;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+
+    std::string currentMtl = "default";
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+
+        std::istringstream ss(line);
+        std::string type;
+        ss >> type;
+
+        if (type == "v") {
+            glm::vec3 v{};
+            ss >> v.x >> v.y >> v.z;
+            positions.push_back(v);
+        }
+        else if (type == "vt") {
+            glm::vec2 t{};
+            ss >> t.x >> t.y;
+            t.y = 1.0f - t.y;
+            texcoords.push_back(t);
+        }
+        else if (type == "vn") {
+            glm::vec3 n{};
+            ss >> n.x >> n.y >> n.z;
+            normals.push_back(n);
+        }
+        else if (type == "usemtl") {
+            ss >> currentMtl;
+            if (currentMtl.empty()) currentMtl = "default";
+        }
+        else if (type == "f") {
+            std::vector<std::string> face;
+            std::string tok;
+            while (ss >> tok) face.push_back(tok);
+            if (face.size() < 3) continue;
+
+            auto emit = [&](const std::string& vtx) {
+                int vi, ti, ni;
+                if (!ParseVVTVN(vtx, vi, ti, ni)) return;
+
+                int p = StreamFixIndex(vi, (int)positions.size());
+                int t = StreamFixIndex(ti, (int)texcoords.size());
+                int n = StreamFixIndex(ni, (int)normals.size());
+
+                if (p < 0 || p >= (int)positions.size()) return;
+
+                ObjVertex gv{};
+                gv.pos = positions[p];
+
+                gv.uv = (t >= 0 && t < (int)texcoords.size()) ? texcoords[t] : glm::vec2(0.0f);
+                gv.normal = (n >= 0 && n < (int)normals.size()) ? normals[n] : glm::vec3(0, 1, 0);
+
+                outByMtl[currentMtl].push_back(gv);
+                };
+
+            // triangulate
+            emit(face[0]); emit(face[1]); emit(face[2]);
+            if (face.size() == 4) { emit(face[0]); emit(face[2]); emit(face[3]); }
+        }
+    }
+
+    return true;
+}
+
+void benchmark(const char *fileName, int iterations) {
+    typedef std::chrono::high_resolution_clock Clock;
+
+    MappedFile probe;
+    if (!probe.open(fileName)) {
+        std::cerr << "Failed to open OBJ: " << fileName << "\n";
+        return;
+    }
+    const size_t bytes = probe.size();
+    const double megabytes = double(bytes) / (1024.0 * 1024.0);
+    probe.close();
+
+    auto run = [&](const char *label, std::function<bool(const char *, MaterialStreams &)> load) {
+        size_t verts = 0;
+        double best = 1e30;
+        for (int i = 0; i < iterations; ++i) {
+            MaterialStreams streams;
+            auto t0 = Clock::now();
+            if (!load(fileName, streams)) return;
+            double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+            if (secs < best) best = secs;
+
+            verts = 0;
+            for (auto &kv : streams) verts += kv.second.size();
+        }
+        printf("%-8s %8.3f ms  %8.1f MB/s  (%zu vertices)\n",
+               label, best * 1000.0, megabytes / best, verts);
+    };
+
+    printf("OBJ parse: %s (%.2f MB, best of %d)\n", fileName, megabytes, iterations);
+    run("stream", loadByMaterialStream);
+    run("mapped", loadByMaterial);
+
+    MaterialStreams serial;
+    loadByMaterial(fileName, serial);
+
+    // The rows below split the file whatever its size, so they time the
+    // chunked path; left to itself the loader parses a file this small serially
+    if (bytes < 2 * MIN_CHUNK_BYTES) {
+        printf("(under %zu MB a thread, scene loads parse this file serially)\n", MIN_CHUNK_BYTES >> 20);
+    }
+
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        char label[32];
+        snprintf(label, sizeof(label), "mt x%u", threads);
+        run(label, [threads](const char *f, MaterialStreams &out) {
+            return loadByMaterialParallel(f, out, threads, 1);
+        });
+
+        MaterialStreams parallel;
+        loadByMaterialParallel(fileName, parallel, threads, 1);
+        bool identical = parallel.size() == serial.size();
+        for (auto &kv : serial) {
+            auto it = parallel.find(kv.first);
+            identical = identical && it != parallel.end() && it->second.size() == kv.second.size() &&
+                (kv.second.empty() ||
+                 memcmp(it->second.data(), kv.second.data(), kv.second.size() * sizeof(ObjVertex)) == 0);
+        }
+        printf("         %s serial output\n", identical ? "matches" : "DIFFERS FROM");
+    }
+}
+
+} // namespace ObjLoader
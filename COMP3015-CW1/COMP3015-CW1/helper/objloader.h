@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ObjVertex {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+// Unique vertices plus a triangle list indexing them.
+struct IndexedMesh {
+    std::vector<ObjVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// One newmtl block of an MTL file.
+struct ObjMaterial {
+    std::string name;
+    glm::vec3 kd = glm::vec3(0.8f);
+    glm::vec3 ks = glm::vec3(0.0f);
+    float ns = 0.0f;
+    float d = 1.0f;
+    std::string mapKd;      // relative to the working directory, empty if none
+};
+
+// Every material of a model welded into one vertex/index buffer pair so
+// it can be drawn with a single call. Each vertex carries the index of
+// its material; parts are the per-material ranges, in material order.
+struct ObjModel {
+    struct Part {
+        uint32_t material;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+    };
+
+    // An index range drawing every part at one level of detail.
+    struct Lod {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error;            // largest simplification error, object units
+    };
+
+    std::vector<ObjMaterial> materials;
+    std::vector<Part> parts;
+    std::vector<ObjVertex> vertices;
+    std::vector<uint16_t> vertexMaterials;
+    std::vector<uint32_t> indices;
+    std::vector<Lod> lods;      // finest first; empty means the whole index buffer is one level
+};
+
+// Read-only pointers to a model's arrays, wherever they live
+// (an ObjModel or a mapped mesh cache).
+struct ObjModelView {
+    const ObjMaterial *materials;
+    size_t materialCount;
+    const ObjModel::Part *parts;
+    size_t partCount;
+    const ObjVertex *vertices;
+    const uint16_t *vertexMaterials;
+    size_t vertexCount;
+    const void *indices;
+    size_t indexCount;
+    uint32_t indexSize;     // 2 or 4 bytes
+    const ObjModel::Lod *lods;
+    size_t lodCount;
+};
+
+namespace ObjLoader
+{
+    // Triangle list per usemtl name, three vertices per triangle.
+    typedef std::unordered_map<std::string, std::vector<ObjVertex>> MaterialStreams;
+    typedef std::unordered_map<std::string, IndexedMesh> IndexedMaterials;
+
+    // Memory-maps the file and parses it in place.
+    bool loadByMaterial(const char *fileName, MaterialStreams &outByMtl);
+
+    // Below this much text per thread the fork/join costs more than it saves
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    // Splits the file into line-aligned chunks parsed on threadCount threads
+    // (0 = one per hardware thread), each at least minChunkBytes. A file too
+    // small for two chunks is parsed on the calling thread. The output is
+    // bit-identical to loadByMaterial.
+    bool loadByMaterialParallel(const char *fileName, MaterialStreams &outByMtl, unsigned threadCount = 0,
+                                size_t minChunkBytes = MIN_CHUNK_BYTES);
+
+    // Same as loadByMaterialParallel, with identical pos/normal/uv corners welded.
+    bool loadIndexedByMaterial(const char *fileName, IndexedMaterials &outByMtl);
+
+    // Path of the first mtllib the OBJ references, resolved against the
+    // OBJ's folder. Empty if there is none.
+    std::string findMtlLib(const char *objFileName);
+
+    // Parses newmtl blocks (Kd, Ks, Ns, d/Tr, map_Kd) and appends them to out.
+    bool loadMtl(const char *fileName, std::vector<ObjMaterial> &out);
+
+    // Loads the OBJ and its mtllib and merges all materials into one model.
+    // Materials used by the OBJ but missing from the MTL get defaults.
+    bool loadModel(const char *fileName, ObjModel &out);
+
+    ObjModelView viewOf(const ObjModel &model);
+
+    // Welds a triangle soup into unique vertices and indices. Vertices are
+    // compared bit for bit, so the welded mesh renders identically.
+    void weld(const std::vector<ObjVertex> &soup, IndexedMesh &out);
+
+    // Vertex shader invocations an indexed draw costs with a FIFO
+    // post-transform cache of cacheSize entries.
+    size_t countCacheMisses(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize = 16);
+
+    // Original getline/istringstream parser, kept as the benchmark baseline.
+    bool loadByMaterialStream(const char *fileName, MaterialStreams &outByMtl);
+
+    // Times both parsers over the same file and prints MB/s for each.
+    void benchmark(const char *fileName, int iterations = 20);
+}
@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 
 struct GLFWwindow;
+class AssetLoader;
 
 class Scene
 {
@@ -13,6 +14,10 @@ public:
     GLFWwindow* window = nullptr;
     void setWindow(GLFWwindow* w) { window = w; }
 
+    // Background loader, or nullptr to load everything in place
+    AssetLoader* loader = nullptr;
+    void setLoader(AssetLoader* l) { loader = l; }
+
     int width;
     int height;
 
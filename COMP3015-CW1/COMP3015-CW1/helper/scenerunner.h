@@ -2,6 +2,7 @@
 #include "scene.h"
 #include <GLFW/glfw3.h>
 #include "glutils.h"
+#include "assetloader.h"
 
 #define WIN_WIDTH 1980
 #define WIN_HEIGHT 1080
@@ -73,13 +74,21 @@ public:
     }
 
     int run(Scene & scene) {
-        scene.setDimensions(fbw, fbh);
-        scene.setWindow(window);
-        scene.initScene();
-        scene.resize(fbw, fbh);
+        {
+            // Assets stream in on the loader's shared context while the loop runs
+            AssetLoader loader(window);
 
-        // Enter the main loop
-        mainLoop(window, scene);
+            scene.setDimensions(fbw, fbh);
+            scene.setWindow(window);
+            scene.setLoader(&loader);
+            scene.initScene();
+            scene.resize(fbw, fbh);
+
+            // Enter the main loop
+            mainLoop(window, scene, loader);
+
+            scene.setLoader(nullptr);
+        }
 
 #ifndef __APPLE__
 		if( debug )
@@ -120,9 +129,11 @@ private:
         }
     }
 
-    void mainLoop(GLFWwindow * window, Scene & scene) {
+    void mainLoop(GLFWwindow * window, Scene & scene, AssetLoader & loader) {
         while( ! glfwWindowShouldClose(window) && !glfwGetKey(window, GLFW_KEY_ESCAPE) ) {
             GLUtils::checkForOpenGLError(__FILE__,__LINE__);
+
+            loader.poll();
 			
             scene.update(float(glfwGetTime()));
             scene.render();
@@ -0,0 +1,90 @@
+#include "shadervariants.h"
+
+#include <iostream>
+#include <sys/stat.h>
+#include <utility>
+
+ShaderVariants::ShaderVariants(std::vector<std::string> shaderFiles, std::vector<std::string> features)
+    : shaderFiles(std::move(shaderFiles)), features(std::move(features)) {}
+
+void ShaderVariants::onLinked(std::function<void(GLSLProgram &)> setup) {
+    this->setup = std::move(setup);
+}
+
+std::string ShaderVariants::spirvName(const std::string &file) {
+    // shader/basic_uniform.frag -> shader/spv/basic_uniform.frag.spv
+    size_t slash = file.find_last_of("/\\");
+    size_t start = slash == std::string::npos ? 0 : slash + 1;
+    return file.substr(0, start) + "spv/" + file.substr(start) + ".spv";
+}
+
+bool ShaderVariants::spirvCurrent(const std::string &file) {
+    struct stat glsl, spv;
+    if (stat(spirvName(file).c_str(), &spv) != 0) return false;
+    if (stat(file.c_str(), &glsl) == 0 && spv.st_mtime < glsl.st_mtime) {
+        std::cerr << spirvName(file) << " is older than " << file << "; compiling the GLSL instead" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ShaderVariants::usesSpirv() {
+    if (spirv < 0) {
+        bool found = GLSLProgram::spirvSupported();
+        for (const std::string &file : shaderFiles) {
+            if (!found) break;
+            found = spirvCurrent(file);
+        }
+        spirv = found ? 1 : 0;
+    }
+    return spirv == 1;
+}
+
+GLSLProgram &ShaderVariants::submit(unsigned key) {
+    Variant &variant = programs[key];
+    if (variant.program) return *variant.program;
+
+    const bool fromSpirv = usesSpirv();
+    std::unique_ptr<GLSLProgram> program(new GLSLProgram());
+    for (size_t i = 0; i < features.size(); ++i) {
+        if (!(key & (1u << i))) continue;
+        if (fromSpirv) program->specialize((GLuint)i, 1);
+        else program->define(features[i]);
+    }
+    try {
+        for (const std::string &file : shaderFiles) {
+            if (fromSpirv) program->compileSpirv(spirvName(file).c_str());
+            else program->compileShader(file.c_str());
+        }
+        program->linkAsync();
+    }
+    catch (...) {
+        programs.erase(key);
+        throw;
+    }
+    variant.program = std::move(program);
+    return *variant.program;
+}
+
+GLSLProgram &ShaderVariants::get(unsigned key) {
+    GLSLProgram &program = submit(key);
+    Variant &variant = programs[key];
+    if (!variant.ready) {
+        if (!program.isLinked()) program.finishLink();
+        if (setup) {
+            program.use();
+            setup(program);
+        }
+        variant.ready = true;
+    }
+    return program;
+}
+
+GLSLProgram::UniformStats ShaderVariants::uniformStats() const {
+    GLSLProgram::UniformStats total;
+    for (const auto &entry : programs) {
+        total.issued += entry.second.program->uniformStats().issued;
+        total.elided += entry.second.program->uniformStats().elided;
+    }
+    return total;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "glslprogram.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One set of shader files built into a program per combination of
+// features, each feature a #define (see GLSLProgram::define), so the
+// shaders can leave out what a feature doesn't need instead of branching
+// on a uniform for it. Bit i of a variant's key turns on features[i].
+//
+// A variant is compiled when first asked for, by get() or, ahead of
+// time, by submit(); each has its own file in the binary cache, so one
+// seen before loads rather than compiles.
+//
+// Where the driver takes SPIR-V and the shader build step has written
+// spv/<file>.spv beside each shader, variants are specialized from those
+// instead: feature i is then specialization constant i, set to 1. The
+// shaders have to declare the features both ways. A module older than
+// its shader was built before the last edit, and the GLSL is used.
+class ShaderVariants {
+public:
+    ShaderVariants(std::vector<std::string> shaderFiles, std::vector<std::string> features);
+
+    // Make it non-copyable.
+    ShaderVariants(const ShaderVariants &) = delete;
+    ShaderVariants & operator=(const ShaderVariants &) = delete;
+
+    // Run once for each variant, linked and bound, before get() first
+    // returns it; for uniforms set once, such as sampler units.
+    void onLinked(std::function<void(GLSLProgram &)> setup);
+
+    // Starts the variant compiling with linkAsync() if nothing has yet,
+    // and returns it, linked or not. Throws as compileShader does.
+    GLSLProgram &submit(unsigned key);
+
+    // The variant, linked and set up, compiling it now if it has to.
+    // Throws as link() does.
+    GLSLProgram &get(unsigned key);
+
+    // Whether variants come from SPIR-V. Decided on the first call, or
+    // the first submit(); needs a current context.
+    bool usesSpirv();
+
+    unsigned variantCount() const { return 1u << features.size(); }
+    int compiledCount() const { return (int)programs.size(); }
+
+    // Summed over every variant compiled
+    GLSLProgram::UniformStats uniformStats() const;
+
+private:
+    struct Variant {
+        std::unique_ptr<GLSLProgram> program;
+        bool ready = false;         // onLinked has run
+    };
+
+    std::vector<std::string> shaderFiles;
+    std::vector<std::string> features;
+    std::function<void(GLSLProgram &)> setup;
+    std::map<unsigned, Variant> programs;
+    int spirv = -1;                 // unknown until usesSpirv()
+
+    static std::string spirvName(const std::string &file);
+    static bool spirvCurrent(const std::string &file);
+};
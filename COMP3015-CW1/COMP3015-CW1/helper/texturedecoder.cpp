@@ -0,0 +1,218 @@
+#include "texturedecoder.h"
+
+#include "mipmap.h"
+#include "../stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// wood.png -> wood.dds for blocks, wood.rgba8.dds for the plain chain;
+// resampled copies add their size, as in wood.1024.dds
+std::string cachePath(const std::string &path, const TextureDecoder::Options &options) {
+    size_t dot = path.find_last_of('.');
+    std::string name = path.substr(0, dot == std::string::npos ? path.size() : dot);
+    if (options.size > 0) name += "." + std::to_string(options.size);
+    return name + (options.compress ? ".dds" : ".rgba8.dds");
+}
+
+// Points levels at whatever holds the data
+void referenceLevels(DecodedTexture &tex) {
+    tex.levels.clear();
+    tex.levelSizes.clear();
+    for (const std::vector<unsigned char> &level : tex.levelData) {
+        tex.levels.push_back(level.data());
+        tex.levelSizes.push_back(level.size());
+    }
+}
+
+} // namespace
+
+size_t DecodedTexture::byteCount() const {
+    size_t bytes = 0;
+    for (size_t size : levelSizes) bytes += size;
+    return bytes;
+}
+
+TextureDecoder::TextureDecoder(unsigned threadCount)
+    : maxThreads(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency())) {}
+
+TextureDecoder::~TextureDecoder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+    for (std::thread &t : workers) t.join();
+}
+
+std::shared_future<TextureDecoder::Result> TextureDecoder::decode(const std::string &path, const Options &options) {
+    // packaged_task is move-only and std::function needs a copyable target
+    std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(
+        [path, options]() { return decodeNow(path, options); });
+    std::shared_future<Result> result = task->get_future().share();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back([task]() { (*task)(); });
+        if (idle < jobs.size() && workers.size() < maxThreads) {
+            workers.emplace_back(&TextureDecoder::run, this);
+            ++idle;
+        }
+    }
+    wake.notify_one();
+    return result;
+}
+
+void TextureDecoder::run() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            --idle;
+        }
+
+        job();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++idle;
+    }
+}
+
+TextureDecoder::Result TextureDecoder::decodeNow(const std::string &path, const Options &options) {
+    auto t0 = Clock::now();
+    std::shared_ptr<DecodedTexture> tex = std::make_shared<DecodedTexture>();
+    tex->path = path;
+
+    // The cache is keyed on the source's contents, so an edited image
+    // misses and is rebuilt however its timestamp looks
+    std::string ddsPath = cachePath(path, options);
+    uint64_t sourceHash = 0;
+    bool haveHash = options.useCache && DdsFile::hashSource(path.c_str(), sourceHash);
+
+    // A cached BC1/BC3 chain is no use without S3TC; rebuild it as BC7
+    if (haveHash && tex->cache.open(ddsPath.c_str(), sourceHash) &&
+        tex->cache.isCompressed() == options.compress &&
+        (!options.compress || tex->cache.format() == BC::BC7 || options.s3tc)) {
+        tex->width = tex->cache.width();
+        tex->height = tex->cache.height();
+        tex->compressed = options.compress;
+        tex->format = tex->cache.format();
+        tex->fromCache = true;
+        for (int i = 0; i < tex->cache.levelCount(); ++i) {
+            tex->levels.push_back(tex->cache.level(i));
+            tex->levelSizes.push_back(tex->cache.levelSize(i));
+        }
+        tex->decodeMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        return tex;
+    }
+    tex->cache.close();
+
+    int w, h, n;
+    unsigned char *data = stbi_load(path.c_str(), &w, &h, &n, 4);
+    if (!data) {
+        std::cerr << "Failed to load texture: " << path << " (" << stbi_failure_reason() << ")" << std::endl;
+        return nullptr;
+    }
+    tex->width = w;
+    tex->height = h;
+
+    // GL's first row is the bottom one; copying rows in reverse does the
+    // flip stb's global flag would, without sharing state between threads
+    const size_t rowBytes = size_t(w) * 4;
+    std::vector<unsigned char> base(rowBytes * h);
+    for (int y = 0; y < h; ++y)
+        memcpy(&base[size_t(y) * rowBytes], data + size_t(h - 1 - y) * rowBytes, rowBytes);
+    stbi_image_free(data);
+
+    if (options.size > 0 && (w != options.size || h != options.size)) {
+        std::vector<unsigned char> resized;
+        MipMap::resize(base.data(), w, h, options.size, options.size, resized);
+        base.swap(resized);
+        w = h = options.size;
+        tex->width = tex->height = options.size;
+    }
+
+    // Full chain, filtered in linear light; tiled textures go far into the distance
+    std::vector<std::vector<unsigned char>> mips;
+    MipMap::generate(base.data(), w, h, mips);
+    const int levelCount = MipMap::levelCount(w, h);
+    for (int level = 0; level < levelCount; ++level)
+        tex->rawBytes += size_t(std::max(1, w >> level)) * std::max(1, h >> level) * 4;
+
+    tex->levelData.resize(levelCount);
+    if (options.compress) {
+        // BC1 for opaque images, BC7 when alpha matters or S3TC is missing
+        bool opaque = true;
+        for (size_t i = 3; i < base.size() && opaque; i += 4) opaque = base[i] == 255;
+        tex->compressed = true;
+        tex->format = (opaque && options.s3tc) ? BC::BC1 : BC::BC7;
+
+        BC::encode(base.data(), w, h, tex->format, tex->levelData[0]);
+        for (int level = 1; level < levelCount; ++level) {
+            BC::encode(mips[level - 1].data(), std::max(1, w >> level), std::max(1, h >> level),
+                       tex->format, tex->levelData[level]);
+        }
+    }
+    else {
+        tex->levelData[0].swap(base);
+        for (int level = 1; level < levelCount; ++level) tex->levelData[level].swap(mips[level - 1]);
+    }
+
+    if (options.useCache) {
+        bool written = haveHash && (options.compress
+            ? DdsFile::write(ddsPath.c_str(), sourceHash, tex->format, w, h, tex->levelData)
+            : DdsFile::writeRGBA8(ddsPath.c_str(), sourceHash, w, h, tex->levelData));
+        if (!written) std::cerr << "Could not write texture cache: " << ddsPath << "\n";
+    }
+    referenceLevels(*tex);
+
+    tex->decodeMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    return tex;
+}
+
+void TextureDecoder::benchmark(const std::vector<std::string> &fileNames, int copies) {
+    Options options;
+    options.useCache = false;
+
+    std::vector<std::string> batch;
+    for (int c = 0; c < copies; ++c) batch.insert(batch.end(), fileNames.begin(), fileNames.end());
+
+    printf("Texture decode: %zu images (%d x %zu files), PNG/JPEG + mips + BC\n",
+           batch.size(), copies, fileNames.size());
+
+    double serialMs = 0.0;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        auto t0 = Clock::now();
+        size_t bytes = 0;
+        {
+            TextureDecoder decoder(threads);
+            std::vector<std::shared_future<Result>> results;
+            for (const std::string &file : batch) results.push_back(decoder.decode(file, options));
+            for (std::shared_future<Result> &result : results) {
+                Result tex = result.get();
+                if (!tex) return;
+                bytes += tex->byteCount();
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        if (threads == 1) serialMs = ms;
+
+        char label[32];
+        snprintf(label, sizeof(label), "x%u", threads);
+        printf("%-5s %9.1f ms  %5.2fx  (%.2f MB out)\n", label, ms, serialMs / ms, bytes / 1048576.0);
+
+        if (threads == maxThreads) break;
+    }
+}
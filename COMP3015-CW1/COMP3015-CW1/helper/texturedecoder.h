@@ -0,0 +1,87 @@
+#pragma once
+
+#include "bcencode.h"
+#include "ddsfile.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Texel data ready for upload: every mip level, either RGBA8 or BC blocks.
+// levels[i] points into levelData or, on a cache hit, into the mapped .dds,
+// which stays mapped for as long as this does.
+struct DecodedTexture {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    bool compressed = false;
+    BC::Format format = BC::BC1;
+    bool fromCache = false;
+
+    std::vector<const unsigned char *> levels;
+    std::vector<size_t> levelSizes;
+
+    size_t rawBytes = 0;        // the chain as RGBA8, for comparison
+    double decodeMs = 0.0;      // read, decode, flip, mips and encode
+
+    std::vector<std::vector<unsigned char>> levelData;
+    DdsFile cache;
+
+    int levelCount() const { return (int)levels.size(); }
+    size_t byteCount() const;
+};
+
+// Decodes images on a pool of worker threads, so a scene's textures are
+// inflated, flipped, mipped and compressed side by side rather than one
+// after another. Workers never touch GL; the caller uploads the result on
+// whichever thread owns a context.
+//
+// Threads are started as jobs arrive, up to the limit, and are idle
+// otherwise.
+class TextureDecoder {
+public:
+    typedef std::shared_ptr<const DecodedTexture> Result;      // null on failure
+
+    struct Options {
+        bool compress = true;   // BC1 when opaque, BC7 otherwise
+        bool s3tc = true;       // BC1 is usable; query on a GL thread with BC::supported
+        bool useCache = true;   // map, or build, the .dds beside the source
+        int size = 0;           // resample to size x size, for texture-array layers; 0 keeps the image's
+    };
+
+    // threadCount 0 = one per hardware thread.
+    explicit TextureDecoder(unsigned threadCount = 0);
+
+    // Drops queued jobs and waits for the ones in progress.
+    ~TextureDecoder();
+
+    // Make it non-copyable.
+    TextureDecoder(const TextureDecoder &) = delete;
+    TextureDecoder & operator=(const TextureDecoder &) = delete;
+
+    std::shared_future<Result> decode(const std::string &path, const Options &options);
+
+    // The same work on the calling thread.
+    static Result decodeNow(const std::string &path, const Options &options);
+
+    // Decodes the files, each `copies` times, as one batch on 1, 2, 4 ...
+    // threads and prints the wall time of each. Caching is off.
+    static void benchmark(const std::vector<std::string> &fileNames, int copies = 4);
+
+private:
+    unsigned maxThreads;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    unsigned idle = 0;
+    bool stopping = false;
+
+    void run();
+};
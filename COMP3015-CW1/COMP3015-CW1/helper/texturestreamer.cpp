@@ -0,0 +1,144 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Uploads are cut into whole rows: rows of texels, or of 4x4 blocks
+int rowCount(const DecodedTexture &d, int level) {
+    int lh = std::max(1, d.height >> level);
+    return d.compressed ? (lh + 3) / 4 : lh;
+}
+
+size_t rowBytes(const DecodedTexture &d, int level) {
+    int lw = std::max(1, d.width >> level);
+    return d.compressed ? size_t((lw + 3) / 4) * BC::blockBytes(d.format) : size_t(lw) * 4;
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(size_t bytesPerFrame, int tailSize)
+    : ring(bytesPerFrame, FencedRing::Skip, "texture streaming buffer"), tailSize(tailSize) {}
+
+void TextureStreamer::uploadRows(const Stream &s, int level, int firstRow, int rows, const void *pixels) {
+    const DecodedTexture &d = *s.src;
+    const int lw = std::max(1, d.width >> level), lh = std::max(1, d.height >> level);
+    const int texelRows = d.compressed ? 4 : 1;
+    const int y = firstRow * texelRows;
+    const int height = std::min(lh - y, rows * texelRows);
+
+    const GLsizei bytes = (GLsizei)(rows * rowBytes(d, level));
+
+    if (s.layer >= 0 && d.compressed) {
+        glCompressedTextureSubImage3D(s.tex, level, 0, y, s.layer, lw, height, 1, BC::glFormat(d.format), bytes, pixels);
+    }
+    else if (s.layer >= 0) {
+        glTextureSubImage3D(s.tex, level, 0, y, s.layer, lw, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    else if (d.compressed) {
+        glCompressedTextureSubImage2D(s.tex, level, 0, y, lw, height, BC::glFormat(d.format), bytes, pixels);
+    }
+    else {
+        glTextureSubImage2D(s.tex, level, 0, y, lw, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+void TextureStreamer::begin(TextureDecoder::Result decoded, GLuint tex, int layer, Resident resident) {
+    if (!ring.created()) ring.create(16);
+
+    const DecodedTexture &d = *decoded;
+    Stream s;
+    s.src = decoded;
+    s.tex = tex;
+    s.layer = layer;
+    s.resident = std::move(resident);
+
+    // The tail is small enough to go in whole this frame
+    int tail = 0;
+    while (tail + 1 < d.levelCount() && std::max(d.width >> tail, d.height >> tail) > tailSize) ++tail;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.name());
+    for (int level = d.levelCount() - 1; level >= tail; --level) {
+        size_t offset = 0;
+        unsigned char *dst = ring.reserve(d.levelSizes[level], offset);
+        if (dst) {
+            memcpy(dst, d.levels[level], d.levelSizes[level]);
+            uploadRows(s, level, 0, rowCount(d, level), (const void *)offset);
+        }
+        else {
+            // Ring busy or full: the tail is only a few KB, send it from client memory
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            uploadRows(s, level, 0, rowCount(d, level), d.levels[level]);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.name());
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    s.resident(tail);
+    if (tail > 0) {
+        s.level = tail - 1;
+        streams.push_back(std::move(s));
+    }
+}
+
+void TextureStreamer::update() {
+    const bool streaming = !streams.empty();
+    size_t streamedThisFrame = 0;
+    if (streaming && drained) {
+        counters = Stats();
+        drained = false;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.name());
+    while (!streams.empty()) {
+        if (!ring.ready()) {
+            ++counters.stalledFrames;
+            break;
+        }
+
+        Stream &s = streams.front();
+        const DecodedTexture &d = *s.src;
+        const size_t bytesPerRow = rowBytes(d, s.level);
+        const int rowsLeft = rowCount(d, s.level) - s.nextRow;
+        const unsigned char *src = d.levels[s.level] + s.nextRow * bytesPerRow;
+        int rows = (int)std::min<size_t>(rowsLeft, ring.room() / bytesPerRow);
+        if (bytesPerRow > ring.segmentBytes()) {
+            // A row wider than a whole segment goes from client memory, one a frame
+            if (streamedThisFrame > 0) break;
+            rows = 1;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            uploadRows(s, s.level, s.nextRow, rows, src);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.name());
+        }
+        else {
+            if (rows == 0) break;   // this frame's share is spent
+            size_t offset = 0;
+            unsigned char *dst = ring.reserve(rows * bytesPerRow, offset);
+            memcpy(dst, src, rows * bytesPerRow);
+            uploadRows(s, s.level, s.nextRow, rows, (const void *)offset);
+        }
+        streamedThisFrame += rows * bytesPerRow;
+
+        // Commands run in order, so the new level is in place before any draw
+        // that samples it
+        s.nextRow += rows;
+        if (s.nextRow == rowCount(d, s.level)) {
+            s.resident(s.level);
+            s.nextRow = 0;
+            if (s.level == 0) streams.pop_front();
+            else --s.level;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // Fence whatever went into this segment, tails from begin() included
+    if (ring.created()) ring.endFrame();
+
+    if (streaming) {
+        ++counters.frames;
+        counters.bytes += streamedThisFrame;
+        counters.peakFrameBytes = std::max(counters.peakFrameBytes, streamedThisFrame);
+        drained = streams.empty();
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "fencedring.h"
+#include "texturedecoder.h"
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <functional>
+
+// Uploads decoded textures a slice at a time from a persistently mapped
+// ring of pixel-unpack buffer, so a large texture costs a bounded number
+// of bytes per frame instead of one long glTextureSubImage2D.
+//
+// begin() uploads the mip tail (levels no larger than tailSize) at once,
+// so the texture can be sampled, blurrily, from the first frame. update()
+// then streams the larger levels, smallest first, in rows. The owner is
+// told each time another level is complete and clamps sampling to it;
+// base-level tricks don't work for array layers or bindless handles,
+// whose texture state is frozen.
+//
+// The ring skips a segment the GPU still reads rather than waiting on it;
+// streaming just resumes a frame later.
+class TextureStreamer {
+public:
+    // Of the run in progress, or of the last one once the queue drains.
+    struct Stats {
+        size_t bytes = 0;           // streamed by update(), tails not included
+        size_t peakFrameBytes = 0;
+        int frames = 0;
+        int stalledFrames = 0;      // waiting on the ring
+    };
+
+    explicit TextureStreamer(size_t bytesPerFrame = 256 * 1024, int tailSize = 128);
+
+    // Make it non-copyable.
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer & operator=(const TextureStreamer &) = delete;
+
+    // Called with the finest level in place; coarser ones are in place too.
+    typedef std::function<void(int level)> Resident;
+
+    // Streams decoded into tex, which already has storage for the chain,
+    // or into one layer of it when tex is an array and layer >= 0. Needs
+    // the context the textures are drawn with.
+    void begin(TextureDecoder::Result decoded, GLuint tex, int layer, Resident resident);
+
+    // Once per frame, on the same context.
+    void update();
+
+    bool busy() const { return !streams.empty(); }
+
+    const Stats &stats() const { return counters; }
+
+private:
+    struct Stream {
+        TextureDecoder::Result src;
+        GLuint tex = 0;
+        int layer = -1;
+        Resident resident;
+        int level = 0;          // being streamed; level + 1 is the finest in place
+        int nextRow = 0;        // in rows of texels or of 4x4 blocks
+    };
+
+    FencedRing ring;
+    int tailSize;
+
+    std::deque<Stream> streams;
+
+    Stats counters;
+    bool drained = true;        // the next stream starts a new run
+
+    void uploadRows(const Stream &s, int level, int firstRow, int rows, const void *pixels);
+};
@@ -0,0 +1,329 @@
+#include "texturetable.h"
+
+#include "glutils.h"
+#include "mipmap.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Trilinear, plus anisotropic for the floor seen at a grazing angle; tiled
+void setSampling(GLuint tex) {
+    GLfloat maxAniso = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAniso);
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameterf(tex, GL_TEXTURE_MAX_ANISOTROPY, std::min(16.0f, maxAniso));
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+// Which of uTexArrays holds a format
+int arrayIndex(bool compressed, BC::Format format) {
+    if (!compressed) return 3;
+    return format == BC::BC1 ? 0 : format == BC::BC3 ? 1 : 2;
+}
+
+} // namespace
+
+size_t TextureTable::Entry::bytes() const {
+    if (!resident) return 0;
+    size_t total = 0;
+    for (size_t level = base; level < levelSizes.size(); ++level) total += levelSizes[level];
+    return total;
+}
+
+TextureTable::~TextureTable() {
+    for (Entry &e : entries) {
+        if (e.texture) {
+            makeHandleNonResident(e.handle);
+            glDeleteTextures(1, &e.texture);
+        }
+    }
+    freeRetired(true);
+    for (GLuint array : arrays) {
+        if (array) glDeleteTextures(1, &array);
+    }
+    if (slotBuffer) glDeleteBuffers(1, &slotBuffer);
+}
+
+void TextureTable::init(bool preferBindless, int maxSlots, int layerSize) {
+    this->maxSlots = maxSlots;
+    this->layerSize = layerSize;
+    entries.reserve(maxSlots);
+
+    if (preferBindless && GLUtils::hasExtension("GL_ARB_bindless_texture")) {
+        getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)glfwGetProcAddress("glGetTextureHandleARB");
+        makeHandleResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)glfwGetProcAddress("glMakeTextureHandleResidentARB");
+        makeHandleNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)glfwGetProcAddress("glMakeTextureHandleNonResidentARB");
+    }
+    tableMode = (getTextureHandle && makeHandleResident && makeHandleNonResident) ? Bindless : Array;
+
+    glCreateBuffers(1, &slotBuffer);
+    glNamedBufferStorage(slotBuffer, sizeof(Slot) * maxSlots, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SLOT_BINDING, slotBuffer);
+
+    printf("Material textures: %s\n", tableMode == Bindless ? "bindless handles" : "texture arrays");
+}
+
+void TextureTable::adjust(TextureDecoder::Options &options) const {
+    if (tableMode == Bindless) return;
+    options.size = layerSize;
+}
+
+int TextureTable::add(TextureDecoder::Result decoded, const TextureDecoder::Options &options, TextureStreamer &streamer) {
+    if ((int)entries.size() == maxSlots) {
+        std::cerr << "Texture table full; " << decoded->path << " not added\n";
+        return -1;
+    }
+
+    const int slot = (int)entries.size();
+    entries.emplace_back();
+    entries[slot].path = decoded->path;
+    entries[slot].options = options;
+    entries[slot].lastUsed = frame;
+    if (!place(slot, decoded, streamer)) {
+        entries.pop_back();
+        return -1;
+    }
+    ++counters.slots;
+    return slot;
+}
+
+bool TextureTable::place(int slot, TextureDecoder::Result decoded, TextureStreamer &streamer) {
+    const DecodedTexture &d = *decoded;
+    Entry &e = entries[slot];
+    const GLenum format = d.compressed ? BC::glFormat(d.format) : GL_RGBA8;
+
+    GLuint target = 0;
+    int layer = -1;
+    if (tableMode == Bindless) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &target);
+        glTextureStorage2D(target, d.levelCount(), format, d.width, d.height);
+
+        // Sampling state is frozen once a handle exists; the levels are not
+        setSampling(target);
+        e.texture = target;
+        e.handle = getTextureHandle(target);
+        makeHandleResident(e.handle);
+    }
+    else {
+        if (d.width != layerSize || d.height != layerSize) {
+            std::cerr << "Texture doesn't match the texture array's layer size: " << d.path << "\n";
+            return false;
+        }
+
+        const int index = arrayIndex(d.compressed, d.format);
+        GLuint &array = arrays[index];
+        if (!array) {
+            glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &array);
+            glTextureStorage3D(array, d.levelCount(), format, layerSize, layerSize, maxSlots);
+            for (size_t size : d.levelSizes) arrayBytes += size * maxSlots;
+            setSampling(array);
+            glBindTextureUnit(ARRAY_UNIT + index, array);
+        }
+        if (!freeLayers[index].empty()) {
+            layer = freeLayers[index].back();
+            freeLayers[index].pop_back();
+        }
+        else {
+            layer = arrayLayers[index]++;
+        }
+        target = array;
+        e.array = index;
+        e.layer = layer;
+    }
+
+    e.width = d.width;
+    e.height = d.height;
+    e.compressed = d.compressed;
+    e.format = d.format;
+    e.levelSizes = d.levelSizes;
+    e.resident = true;
+    e.base = 0;
+    e.finest = d.levelCount();
+    writeSlot(slot);
+
+    streamer.begin(decoded, target, layer, [this, slot](int level) {
+        entries[slot].finest = level;
+        setMinLod(slot, level);
+    });
+    return true;
+}
+
+void TextureTable::setBudget(size_t bytes) {
+    if (tableMode == Array) return;
+    budget = bytes;
+    counters.budget = bytes;
+}
+
+void TextureTable::touch(int slot) {
+    if (slot >= 0 && slot < (int)entries.size()) entries[slot].lastUsed = frame;
+}
+
+void TextureTable::release(Entry &e) {
+    if (e.texture) retire(e.texture, e.handle);
+    if (e.array >= 0) freeLayers[e.array].push_back(e.layer);
+    e.texture = 0;
+    e.handle = 0;
+    e.array = -1;
+    e.layer = -1;
+    e.resident = false;
+}
+
+void TextureTable::retire(GLuint texture, GLuint64 handle) {
+    Retired r;
+    r.texture = texture;
+    r.handle = handle;
+    r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    retired.push_back(r);
+}
+
+void TextureTable::freeRetired(bool wait) {
+    std::vector<Retired> waiting;
+    for (Retired &r : retired) {
+        if (!wait && glClientWaitSync(r.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            waiting.push_back(r);
+            continue;
+        }
+        glDeleteSync(r.fence);
+        makeHandleNonResident(r.handle);
+        glDeleteTextures(1, &r.texture);
+    }
+    retired.swap(waiting);
+}
+
+bool TextureTable::canTrim(const Entry &e) const {
+    return e.texture && !e.streaming() && e.base + 1 < (int)e.levelSizes.size() &&
+           std::max(e.width >> e.base, e.height >> e.base) > TRIM_FLOOR;
+}
+
+void TextureTable::trim(int slot) {
+    // Storage is immutable, so the smaller chain is a new texture with a new
+    // handle, filled by copying the levels it keeps
+    Entry &e = entries[slot];
+    const int base = e.base + 1;
+    const int levels = (int)e.levelSizes.size();
+    GLuint tex = 0;
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    glTextureStorage2D(tex, levels - base, e.compressed ? BC::glFormat(e.format) : GL_RGBA8,
+                       std::max(1, e.width >> base), std::max(1, e.height >> base));
+    setSampling(tex);
+    for (int level = base; level < levels; ++level) {
+        glCopyImageSubData(e.texture, GL_TEXTURE_2D, level - e.base, 0, 0, 0, tex, GL_TEXTURE_2D, level - base, 0, 0, 0,
+                           std::max(1, e.width >> level), std::max(1, e.height >> level), 1);
+    }
+    GLuint64 handle = getTextureHandle(tex);
+    makeHandleResident(handle);
+
+    retire(e.texture, e.handle);
+    e.texture = tex;
+    e.handle = handle;
+    e.base = e.finest = base;
+    writeSlot(slot);
+    ++counters.trims;
+}
+
+void TextureTable::evict(int slot) {
+    release(entries[slot]);
+    writeSlot(slot);
+    ++counters.evictions;
+}
+
+size_t TextureTable::residentBytes() const {
+    if (tableMode == Array) return arrayBytes;
+    size_t total = 0;
+    for (const Entry &e : entries) total += e.bytes();
+    return total;
+}
+
+void TextureTable::update(TextureDecoder &decoder, TextureStreamer &streamer) {
+    freeRetired(false);
+
+    // Over budget: least recently used first, trimmed down to the floor,
+    // then evicted if not in view. Slots still streaming are left alone.
+    size_t bytes = residentBytes();
+    if (budget > 0 && bytes > budget) {
+        std::vector<int> order;
+        for (int slot = 0; slot < (int)entries.size(); ++slot) {
+            if (entries[slot].resident && !entries[slot].streaming()) order.push_back(slot);
+        }
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return entries[a].lastUsed < entries[b].lastUsed;
+        });
+
+        for (int slot : order) {
+            Entry &e = entries[slot];
+            while (bytes > budget && canTrim(e)) {
+                bytes -= e.bytes();
+                trim(slot);
+                bytes += e.bytes();
+            }
+            if (bytes > budget && e.lastUsed != frame) {
+                bytes -= e.bytes();
+                evict(slot);
+            }
+            if (bytes <= budget) break;
+        }
+    }
+
+    // Slots in view that lost levels come back once the whole chain fits
+    for (int slot = 0; slot < (int)entries.size(); ++slot) {
+        Entry &e = entries[slot];
+        if (e.reloading) {
+            if (e.reload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+            e.reloading = false;
+            TextureDecoder::Result result = e.reload.get();
+            e.reload = std::shared_future<TextureDecoder::Result>();
+            if (!result) continue;
+            if (e.resident) release(e);
+            if (place(slot, result, streamer)) ++counters.reloads;
+            else writeSlot(slot);
+            continue;
+        }
+
+        if (e.lastUsed != frame || e.streaming() || (e.resident && e.base == 0)) continue;
+        size_t full = 0;
+        for (size_t size : e.levelSizes) full += size;
+        if (budget > 0 && residentBytes() - e.bytes() + full > budget) continue;
+        e.reload = decoder.decode(e.path, e.options);
+        e.reloading = true;
+    }
+
+    counters.resident = counters.trimmed = 0;
+    for (const Entry &e : entries) {
+        if (e.resident) ++counters.resident;
+        if (e.resident && e.base > 0) ++counters.trimmed;
+    }
+    counters.bytes = residentBytes();
+    ++frame;
+}
+
+void TextureTable::writeSlot(int slot) {
+    const Entry &e = entries[slot];
+    Slot entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.array = -1;
+    if (e.resident) {
+        entry.handle[0] = GLuint(e.handle);
+        entry.handle[1] = GLuint(e.handle >> 32);
+        entry.array = e.array;
+        entry.layer = float(e.layer);
+        entry.minLod = float(e.finest - e.base);
+        entry.size[0] = float(std::max(1, e.width >> e.base));
+        entry.size[1] = float(std::max(1, e.height >> e.base));
+    }
+    glNamedBufferSubData(slotBuffer, sizeof(Slot) * slot, sizeof(Slot), &entry);
+}
+
+void TextureTable::setMinLod(int slot, int level) {
+    float minLod = float(level - entries[slot].base);
+    glNamedBufferSubData(slotBuffer, sizeof(Slot) * slot + offsetof(Slot, minLod), sizeof(float), &minLod);
+}
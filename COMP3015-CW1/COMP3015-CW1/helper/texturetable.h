@@ -0,0 +1,176 @@
+#pragma once
+
+#include "texturedecoder.h"
+#include "texturestreamer.h"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+// ARB_bindless_texture entry points; the extension is not in the generated loader
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+// Material textures that shaders reach through a buffer rather than
+// texture units, so nothing is bound per object and objects with
+// different textures can share a draw.
+//
+// With ARB_bindless_texture each texture keeps its own size and format
+// and a slot holds its handle. Otherwise textures are layers of texture
+// arrays, one per format, made on first use and bound once to
+// ARRAY_UNIT + the format's index; a slot holds the array and layer.
+// Images are then resampled to the layer size as they are decoded (see
+// adjust()).
+//
+// Slots are an SSBO at SLOT_BINDING, laid out as the shader's TextureSlot.
+// A slot's minLod follows the streamer, so levels that haven't arrived
+// are never sampled.
+//
+// Residency, bindless only: every slot's bytes count against a budget.
+// Slots the scene hasn't touch()ed lately go first: a texture is copied
+// into a smaller one without its top level, down to TRIM_FLOOR texels,
+// and is then evicted. Slots in view are trimmed, never evicted. An
+// evicted slot reads as empty, so objects show their base colour.
+// Touching a trimmed or evicted slot reloads it, through the decoder's
+// cache, once it fits the budget again.
+//
+// Arrays are not budgeted: each is allocated whole, maxSlots layers, on
+// first use, and evicting a layer would free nothing. Their bytes are
+// the arrays' full storage.
+class TextureTable {
+public:
+    enum Mode { Bindless, Array };
+
+    static const GLuint SLOT_BINDING = 4;
+    static const GLuint ARRAY_UNIT = 0;
+    static const int ARRAY_FORMATS = 4;     // BC1, BC3, BC7, RGBA8: uTexArrays[4]
+
+    struct Stats {
+        int slots = 0;
+        int resident = 0;
+        int trimmed = 0;            // resident without their top levels
+        size_t bytes = 0;           // of resident slots, or of whole arrays
+        size_t budget = 0;          // 0 when arrays are in use
+        size_t trims = 0;           // levels dropped so far
+        size_t evictions = 0;
+        size_t reloads = 0;
+    };
+
+    TextureTable() = default;
+    ~TextureTable();
+
+    // Make it non-copyable.
+    TextureTable(const TextureTable &) = delete;
+    TextureTable & operator=(const TextureTable &) = delete;
+
+    // Picks bindless when asked for and available. Arrays hold up to
+    // maxSlots layers of layerSize x layerSize. Needs a current context.
+    void init(bool preferBindless, int maxSlots, int layerSize);
+
+    Mode mode() const { return tableMode; }
+
+    // Makes decoder output fit the table: array layers share a size.
+    void adjust(TextureDecoder::Options &options) const;
+
+    // Allocates the texture or layer and starts streaming into it. options
+    // are the ones decoded was made with, for reloading it. Returns the
+    // slot, or -1 if the table is full or the image doesn't fit.
+    int add(TextureDecoder::Result decoded, const TextureDecoder::Options &options, TextureStreamer &streamer);
+
+    // 0 for no limit. Ignored for arrays; call after init().
+    void setBudget(size_t bytes);
+
+    // The slot is drawn this frame.
+    void touch(int slot);
+
+    // Once per frame, before the touches: trims and evicts down to the
+    // budget, and reloads touched slots that were. decoder and streamer
+    // are the ones slots are added with.
+    void update(TextureDecoder &decoder, TextureStreamer &streamer);
+
+    const Stats &stats() const { return counters; }
+
+private:
+    // std430, as TextureSlot in basic_uniform.frag. Empty (evicted) when
+    // the handle is 0 and array is -1.
+    struct Slot {
+        GLuint handle[2];
+        float layer;
+        float minLod;
+        float size[2];
+        GLint array;
+        float unused;
+    };
+
+    // What the table knows of a slot; levels are numbered as in the full
+    // chain, whatever the texture holds now
+    struct Entry {
+        std::string path;
+        TextureDecoder::Options options;
+        int width = 0;
+        int height = 0;
+        bool compressed = false;
+        BC::Format format = BC::BC1;
+        std::vector<size_t> levelSizes;
+
+        bool resident = false;
+        int base = 0;               // finest level allocated
+        int finest = 0;             // finest level streamed in
+        GLuint texture = 0;         // bindless only
+        GLuint64 handle = 0;
+        int array = -1;             // array mode only
+        int layer = -1;
+
+        uint32_t lastUsed = 0;
+        bool reloading = false;
+        std::shared_future<TextureDecoder::Result> reload;
+
+        size_t bytes() const;
+        bool streaming() const { return resident && finest > base; }
+    };
+
+    // A texture handle and its texture, kept until draws that may still use
+    // them have finished
+    struct Retired {
+        GLuint texture;
+        GLuint64 handle;
+        GLsync fence;
+    };
+
+    static const int TRIM_FLOOR = 128;
+
+    Mode tableMode = Array;
+    int maxSlots = 0;
+    int layerSize = 0;
+
+    GLuint slotBuffer = 0;
+    GLuint arrays[ARRAY_FORMATS] = {};
+    int arrayLayers[ARRAY_FORMATS] = {};
+    size_t arrayBytes = 0;      // all layers of all arrays
+    std::vector<int> freeLayers[ARRAY_FORMATS];
+    std::vector<Entry> entries;
+    std::vector<Retired> retired;
+
+    size_t budget = 0;
+    uint32_t frame = 1;
+    Stats counters;
+
+    PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = nullptr;
+    PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeHandleResident = nullptr;
+    PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC makeHandleNonResident = nullptr;
+
+    bool place(int slot, TextureDecoder::Result decoded, TextureStreamer &streamer);
+    void release(Entry &e);
+    void retire(GLuint texture, GLuint64 handle);
+    bool canTrim(const Entry &e) const;
+    void trim(int slot);
+    void evict(int slot);
+    void freeRetired(bool wait);
+    size_t residentBytes() const;
+    void writeSlot(int slot);
+    void setMinLod(int slot, int level);
+};
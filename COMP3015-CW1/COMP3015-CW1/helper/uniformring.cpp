@@ -0,0 +1,38 @@
+#include "uniformring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+UniformRing::UniformRing(size_t bytesPerFrame) : ring(bytesPerFrame, FencedRing::Wait, "uniform buffer ring") {}
+
+void UniformRing::beginFrame() {
+    if (!ring.created()) {
+        GLint align = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        ring.create(align > 0 ? size_t(align) : 256);
+    }
+    ring.ready();
+}
+
+bool UniformRing::bind(GLuint binding, const void *data, size_t size) {
+    size_t offset = 0;
+    unsigned char *dst = ring.reserve(size, offset);
+    if (!dst) {
+        if (!reportedFull) {
+            std::cerr << "Uniform ring full: " << ring.segmentBytes() << " bytes a frame are not enough" << std::endl;
+            reportedFull = true;
+        }
+        return false;
+    }
+
+    memcpy(dst, data, size);
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring.name(), (GLintptr)offset, (GLsizeiptr)size);
+    return true;
+}
+
+void UniformRing::endFrame() {
+    if (!ring.created()) return;
+    peak = std::max(peak, ring.used());
+    ring.endFrame();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "fencedring.h"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// std140 uniform blocks written into a persistently mapped ring and bound
+// with glBindBufferRange, so a block costs a memcpy and one bind rather
+// than a glUniform call per member.
+//
+// Unlike texture streaming, a frame can't go without its uniforms, so the
+// ring waits for a segment the GPU still reads rather than skipping it.
+class UniformRing {
+public:
+    explicit UniformRing(size_t bytesPerFrame = 64 * 1024);
+
+    // Make it non-copyable.
+    UniformRing(const UniformRing &) = delete;
+    UniformRing & operator=(const UniformRing &) = delete;
+
+    // Around everything drawn with blocks from the ring, once per frame.
+    // Needs the context the blocks are drawn with.
+    void beginFrame();
+    void endFrame();
+
+    // Copies block into this frame's segment and binds it to the uniform
+    // block binding point. Returns false, binding nothing, when the
+    // segment is full.
+    template <typename T>
+    bool bind(GLuint binding, const T &block) { return bind(binding, &block, sizeof(T)); }
+    bool bind(GLuint binding, const void *data, size_t size);
+
+    // Most bytes one frame has used; for sizing bytesPerFrame.
+    size_t peakBytes() const { return peak; }
+
+private:
+    FencedRing ring;
+    size_t peak = 0;
+    bool reportedFull = false;
+};
@@ -0,0 +1,106 @@
+#include "vertexpack.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+namespace VertexPack {
+
+PackBounds boundsOf(const ObjVertex *vertices, size_t count) {
+    PackBounds b;
+    if (count == 0) return b;
+
+    glm::vec3 lo = vertices[0].pos;
+    glm::vec3 hi = vertices[0].pos;
+    for (size_t i = 1; i < count; ++i) {
+        lo = glm::min(lo, vertices[i].pos);
+        hi = glm::max(hi, vertices[i].pos);
+    }
+
+    b.offset = lo;
+    // A flat axis (the ground's y) keeps scale 0 and decodes to the offset exactly
+    b.scale = hi - lo;
+    return b;
+}
+
+void pack(const ObjVertex *vertices, const uint16_t *materials, size_t count,
+          std::vector<PackedVertex> &out, PackBounds &outBounds) {
+    outBounds = boundsOf(vertices, count);
+    out.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        const ObjVertex &src = vertices[i];
+        PackedVertex &dst = out[i];
+
+        for (int c = 0; c < 3; ++c) {
+            float q = 0.0f;
+            if (outBounds.scale[c] > 0.0f)
+                q = (src.pos[c] - outBounds.offset[c]) / outBounds.scale[c] * 65535.0f;
+            dst.pos[c] = (uint16_t)std::min(std::max(std::floor(q + 0.5f), 0.0f), 65535.0f);
+        }
+        dst.material = materials ? materials[i] : 0;
+
+        glm::vec3 n = src.normal;
+        float len = glm::length(n);
+        if (len > 0.0f) n /= len;
+        dst.normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+
+        dst.uv[0] = glm::packHalf1x16(src.uv.x);
+        dst.uv[1] = glm::packHalf1x16(src.uv.y);
+    }
+}
+
+ObjVertex unpack(const PackedVertex &v, const PackBounds &bounds) {
+    ObjVertex out;
+    out.pos = bounds.offset + bounds.scale * (glm::vec3(v.pos[0], v.pos[1], v.pos[2]) / 65535.0f);
+    out.normal = glm::vec3(glm::unpackSnorm3x10_1x2(v.normal));
+    out.uv = glm::vec2(glm::unpackHalf1x16(v.uv[0]), glm::unpackHalf1x16(v.uv[1]));
+    return out;
+}
+
+Error measure(const ObjVertex *vertices, const PackedVertex *packed, size_t count, const PackBounds &bounds) {
+    Error e;
+    for (size_t i = 0; i < count; ++i) {
+        const ObjVertex &a = vertices[i];
+        ObjVertex b = unpack(packed[i], bounds);
+
+        e.position = std::max(e.position, glm::length(a.pos - b.pos));
+        e.uv = std::max(e.uv, std::max(std::abs(a.uv.x - b.uv.x), std::abs(a.uv.y - b.uv.y)));
+
+        // Degenerate source normals have no direction to compare against
+        float la = glm::length(a.normal);
+        float lb = glm::length(b.normal);
+        if (la > 0.0f && lb > 0.0f) {
+            float c = glm::clamp(glm::dot(a.normal / la, b.normal / lb), -1.0f, 1.0f);
+            e.normalDegrees = std::max(e.normalDegrees, glm::degrees(std::acos(c)));
+        }
+    }
+    return e;
+}
+
+void setAttribPointers() {
+    const GLsizei stride = sizeof(PackedVertex);
+
+    // layout 0: position, unorm16 -> [0,1], rescaled by uPosScale/uPosOffset
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, pos));
+
+    // layout 1: normal, decoded by the fetch hardware
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+
+    // layout 2: uv
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, uv));
+
+    // layout 3: material index
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, stride, (void*)offsetof(PackedVertex, material));
+}
+
+} // namespace VertexPack
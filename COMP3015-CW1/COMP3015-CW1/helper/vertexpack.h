@@ -0,0 +1,52 @@
+#pragma once
+
+#include "objloader.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 16-byte vertex, half the size of ObjVertex:
+//   pos      3 x unorm16, dequantized by the mesh's PackBounds in the vertex shader
+//   material uint16, the guard's per-vertex material index (0 elsewhere)
+//   normal   snorm 10_10_10_2 (GL_INT_2_10_10_10_REV), w unused
+//   uv       2 x half float
+struct PackedVertex {
+    uint16_t pos[3];
+    uint16_t material;
+    uint32_t normal;
+    uint16_t uv[2];
+};
+
+// Maps unorm16 positions back to object space: pos = offset + scale * p,
+// with p the normalized [0,1] value the attribute fetch produces.
+// The default is the identity, which is what the float layout uses.
+struct PackBounds {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+namespace VertexPack
+{
+    // Largest differences between a float mesh and its packed copy.
+    struct Error {
+        float position = 0.0f;      // object-space units
+        float normalDegrees = 0.0f;
+        float uv = 0.0f;
+    };
+
+    PackBounds boundsOf(const ObjVertex *vertices, size_t count);
+
+    // materials may be null. out is resized to count.
+    void pack(const ObjVertex *vertices, const uint16_t *materials, size_t count,
+              std::vector<PackedVertex> &out, PackBounds &outBounds);
+
+    ObjVertex unpack(const PackedVertex &v, const PackBounds &bounds);
+
+    Error measure(const ObjVertex *vertices, const PackedVertex *packed, size_t count, const PackBounds &bounds);
+
+    // Sets up attributes 0-3 of the bound VAO for the buffer bound to GL_ARRAY_BUFFER.
+    void setAttribPointers();
+}
@@ -0,0 +1,368 @@
+#include "virtualtexture.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Texel coordinate wrapped into [0, size), for a power-of-two size
+int wrap(int i, int size) {
+    return i & (size - 1);
+}
+
+bool isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+} // namespace
+
+VirtualTexture::~VirtualTexture() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+
+    if (!atlas) return;
+    for (int i = 0; i < READBACK_BUFFERS; ++i) {
+        if (readbackFence[i]) glDeleteSync(readbackFence[i]);
+        glUnmapNamedBuffer(readback[i]);
+    }
+    glDeleteBuffers(READBACK_BUFFERS, readback);
+    glDeleteBuffers(1, &requestBuffer);
+    glDeleteFramebuffers(1, &feedbackFbo);
+    glDeleteTextures(1, &pageTable);
+    glDeleteTextures(1, &atlas);
+}
+
+void VirtualTexture::init(int virtualSize, int atlasPages, int cachePages) {
+    if (virtualSize % PAGE_SIZE != 0 || !isPowerOfTwo(virtualSize / PAGE_SIZE) || atlasPages > 256) {
+        std::cerr << "Unsupported virtual texture size: " << virtualSize << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    this->atlasPages = atlasPages;
+    this->cachePages = cachePages;
+
+    pages = virtualSize / PAGE_SIZE;
+    levels = 1;
+    while ((pages >> (levels - 1)) > 1) ++levels;
+
+    int pageCount = 0;
+    levelFirst.clear();
+    for (int level = 0; level < levels; ++level) {
+        levelFirst.push_back(pageCount);
+        pageCount += (pages >> level) * (pages >> level);
+    }
+    slotOfPage.assign(pageCount, -1);
+    lastUsed.assign(pageCount, 0);
+    pageOfSlot.assign(atlasPages * atlasPages, -1);
+
+    // RGBA8UI: xy = atlas slot, z = level held there, w = 1 when anything is.
+    // Integer textures must be sampled nearest; the shader uses texelFetch.
+    glCreateTextures(GL_TEXTURE_2D, 1, &pageTable);
+    glTextureStorage2D(pageTable, levels, GL_RGBA8UI, pages, pages);
+    glTextureParameteri(pageTable, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(pageTable, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTextureUnit(PAGE_TABLE_UNIT, pageTable);
+
+    // One level: the shader picks the virtual level and filters within a page
+    const int atlasSize = atlasPages * SLOT_SIZE;
+    glCreateTextures(GL_TEXTURE_2D, 1, &atlas);
+    glTextureStorage2D(atlas, 1, GL_RGBA8, atlasSize, atlasSize);
+    glTextureParameteri(atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTextureUnit(ATLAS_UNIT, atlas);
+
+    // One flag per page, and mapped copies for reading them back
+    const GLsizeiptr flagBytes = GLsizeiptr(pageCount) * sizeof(GLuint);
+    glCreateBuffers(1, &requestBuffer);
+    glNamedBufferStorage(requestBuffer, flagBytes, nullptr, 0);
+    glClearNamedBufferData(requestBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(READBACK_BUFFERS, readback);
+    for (int i = 0; i < READBACK_BUFFERS; ++i) {
+        glNamedBufferStorage(readback[i], flagBytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        readbackMapped[i] = (const GLuint *)glMapNamedBufferRange(readback[i], 0, flagBytes, flags);
+        if (!readbackMapped[i]) {
+            std::cerr << "Unable to map the virtual texture feedback buffer." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Nothing to render into: the feedback shader only writes the flags
+    glCreateFramebuffers(1, &feedbackFbo);
+
+    counters.atlasPages = atlasPages * atlasPages;
+    counters.cachePages = cachePages;
+    counters.atlasBytes = size_t(atlasSize) * atlasSize * 4 + size_t(pageCount) * 4;
+    for (int level = 0; level < levels; ++level) {
+        double across = double(std::max(1, virtualSize >> level));
+        counters.virtualBytes += across * across * 4.0;
+    }
+    tableDirty = true;
+}
+
+void VirtualTexture::setSource(PageSource pageSource) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        source = std::move(pageSource);
+        if (!worker.joinable()) worker = std::thread(&VirtualTexture::run, this);
+    }
+    wake.notify_one();
+}
+
+VirtualTexture::PageSource VirtualTexture::repeatImage(TextureDecoder::Result image) {
+    return [image](int level, int x, int y, unsigned char *rgba) {
+        const DecodedTexture &d = *image;
+        if (d.compressed || !isPowerOfTwo(d.width) || !isPowerOfTwo(d.height) || d.levelCount() == 0) return false;
+
+        // Level n of the virtual texture is level n of the image, repeated
+        const int l = std::min(level, d.levelCount() - 1);
+        const int w = std::max(1, d.width >> l), h = std::max(1, d.height >> l);
+        const unsigned char *src = d.levels[l];
+        for (int j = 0; j < SLOT_SIZE; ++j) {
+            const int sy = wrap(y * PAGE_SIZE + j - BORDER, h);
+            unsigned char *dst = rgba + size_t(j) * SLOT_SIZE * 4;
+            for (int i = 0; i < SLOT_SIZE; ++i) {
+                const int sx = wrap(x * PAGE_SIZE + i - BORDER, w);
+                memcpy(dst + i * 4, src + (size_t(sy) * w + sx) * 4, 4);
+            }
+        }
+        return true;
+    };
+}
+
+void VirtualTexture::beginFeedback(int screenWidth, int screenHeight) {
+    const int w = std::max(1, screenWidth / FEEDBACK_DIVISOR);
+    const int h = std::max(1, screenHeight / FEEDBACK_DIVISOR);
+    if (w != feedbackWidth || h != feedbackHeight) {
+        glNamedFramebufferParameteri(feedbackFbo, GL_FRAMEBUFFER_DEFAULT_WIDTH, w);
+        glNamedFramebufferParameteri(feedbackFbo, GL_FRAMEBUFFER_DEFAULT_HEIGHT, h);
+        feedbackWidth = w;
+        feedbackHeight = h;
+    }
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, feedbackFbo);
+    glViewport(0, 0, w, h);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REQUEST_BINDING, requestBuffer);
+}
+
+void VirtualTexture::endFeedback() {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+
+    // With every copy still in flight this frame's flags are dropped; the
+    // next frame asks for much the same pages
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    GLsync &fence = readbackFence[readbackNext];
+    if (!fence) {
+        glCopyNamedBufferSubData(requestBuffer, readback[readbackNext], 0, 0, GLsizeiptr(lastUsed.size()) * sizeof(GLuint));
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readbackNext = (readbackNext + 1) % READBACK_BUFFERS;
+    }
+    glClearNamedBufferData(requestBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+}
+
+void VirtualTexture::pageCoords(int id, int &level, int &x, int &y) const {
+    level = int(std::upper_bound(levelFirst.begin(), levelFirst.end(), id) - levelFirst.begin()) - 1;
+    const int across = pages >> level;
+    x = (id - levelFirst[level]) % across;
+    y = (id - levelFirst[level]) / across;
+}
+
+void VirtualTexture::readFeedback(const GLuint *flags) {
+    // A page keeps its ancestors wanted too: they are the fallback while it
+    // loads, and the coarser level of trilinear filtering
+    ++serial;
+    for (int level = 0; level < levels; ++level) {
+        const int across = pages >> level;
+        for (int id = levelFirst[level], end = id + across * across; id < end; ++id) {
+            if (!flags[id]) continue;
+            int x = (id - levelFirst[level]) % across, y = (id - levelFirst[level]) / across;
+            for (int l = level; l < levels && lastUsed[levelFirst[l] + y * (pages >> l) + x] != serial; ++l) {
+                lastUsed[levelFirst[l] + y * (pages >> l) + x] = serial;
+                x /= 2;
+                y /= 2;
+            }
+        }
+    }
+
+    // Coarsest first: a coarse page stands in for many fine ones
+    wanted.clear();
+    for (int level = levels - 1; level >= 0; --level) {
+        const int across = pages >> level;
+        for (int id = levelFirst[level], end = id + across * across; id < end; ++id) {
+            if (lastUsed[id] == serial && slotOfPage[id] < 0 && !failed.count(id)) wanted.push_back(id);
+        }
+    }
+}
+
+void VirtualTexture::takeFinished() {
+    std::vector<std::pair<int, std::vector<unsigned char>>> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+    }
+
+    for (std::pair<int, std::vector<unsigned char>> &page : done) {
+        loading.erase(page.first);
+        if (page.second.empty()) {
+            if (failed.empty()) std::cerr << "Virtual texture source has no page " << page.first << std::endl;
+            failed.insert(page.first);
+            continue;
+        }
+        ++counters.loaded;
+        if (cache.count(page.first)) continue;
+
+        cacheAge.push_front(page.first);
+        CachedPage &entry = cache[page.first];
+        entry.texels = std::move(page.second);
+        entry.age = cacheAge.begin();
+    }
+
+    while ((int)cache.size() > cachePages) {
+        cache.erase(cacheAge.back());
+        cacheAge.pop_back();
+    }
+}
+
+void VirtualTexture::queueLoads() {
+    // Requests not yet started are replaced by the latest ones
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int id : jobs) loading.erase(id);
+        jobs.clear();
+        for (int id : wanted) {
+            if (cache.count(id) || loading.count(id)) continue;
+            jobs.push_back(id);
+            loading.insert(id);
+        }
+    }
+    wake.notify_one();
+}
+
+int VirtualTexture::freeSlot() {
+    int best = -1;
+    for (int slot = 0; slot < (int)pageOfSlot.size(); ++slot) {
+        const int page = pageOfSlot[slot];
+        if (page < 0) return slot;
+        // Pages asked for by the latest feedback are on screen
+        if (lastUsed[page] != serial && (best < 0 || lastUsed[page] < lastUsed[pageOfSlot[best]])) best = slot;
+    }
+    return best;
+}
+
+void VirtualTexture::uploadPages() {
+    int uploads = 0;
+    std::vector<int> stillWanted;
+    for (int id : wanted) {
+        std::unordered_map<int, CachedPage>::iterator cached = cache.find(id);
+        int slot = -1;
+        if (slotOfPage[id] >= 0) continue;
+        if (uploads == uploadsPerFrame || cached == cache.end() || (slot = freeSlot()) < 0) {
+            stillWanted.push_back(id);
+            continue;
+        }
+
+        if (pageOfSlot[slot] >= 0) {
+            slotOfPage[pageOfSlot[slot]] = -1;
+            ++counters.evicted;
+            --counters.residentPages;
+        }
+        pageOfSlot[slot] = id;
+        slotOfPage[id] = slot;
+        ++counters.residentPages;
+
+        glTextureSubImage2D(atlas, 0, (slot % atlasPages) * SLOT_SIZE, (slot / atlasPages) * SLOT_SIZE,
+                            SLOT_SIZE, SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, cached->second.texels.data());
+        cacheAge.splice(cacheAge.begin(), cacheAge, cached->second.age);
+        ++counters.uploaded;
+        ++uploads;
+        tableDirty = true;
+    }
+    wanted.swap(stillWanted);
+}
+
+void VirtualTexture::rebuildPageTable() {
+    // Coarsest level first, so a missing page can copy its parent's entry
+    std::vector<unsigned char> parent, entries;
+    for (int level = levels - 1; level >= 0; --level) {
+        const int across = pages >> level;
+        entries.assign(size_t(across) * across * 4, 0);
+        for (int y = 0; y < across; ++y) {
+            for (int x = 0; x < across; ++x) {
+                unsigned char *e = &entries[(size_t(y) * across + x) * 4];
+                const int slot = slotOfPage[levelFirst[level] + y * across + x];
+                if (slot >= 0) {
+                    e[0] = (unsigned char)(slot % atlasPages);
+                    e[1] = (unsigned char)(slot / atlasPages);
+                    e[2] = (unsigned char)level;
+                    e[3] = 1;
+                }
+                else if (!parent.empty()) {
+                    memcpy(e, &parent[(size_t(y / 2) * (across / 2) + x / 2) * 4], 4);
+                }
+            }
+        }
+        glTextureSubImage2D(pageTable, level, 0, 0, across, across, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries.data());
+        parent.swap(entries);
+    }
+    tableDirty = false;
+}
+
+void VirtualTexture::update() {
+    if (!atlas) return;
+
+    // Oldest copy first, so serials follow frame order
+    bool newFeedback = false;
+    for (int i = 0; i < READBACK_BUFFERS; ++i) {
+        const int b = (readbackNext + i) % READBACK_BUFFERS;
+        GLsync &fence = readbackFence[b];
+        if (!fence) continue;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) break;
+        glDeleteSync(fence);
+        fence = nullptr;
+        readFeedback(readbackMapped[b]);
+        newFeedback = true;
+    }
+
+    takeFinished();
+    if (newFeedback) queueLoads();
+    uploadPages();
+    if (tableDirty) rebuildPageTable();
+
+    counters.cachedPages = (int)cache.size();
+    counters.wantedPages = (int)wanted.size();
+}
+
+void VirtualTexture::run() {
+    for (;;) {
+        int id = -1;
+        PageSource pageSource;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            id = jobs.front();
+            jobs.pop_front();
+            pageSource = source;
+        }
+
+        int level = 0, x = 0, y = 0;
+        pageCoords(id, level, x, y);
+        std::vector<unsigned char> texels(size_t(SLOT_SIZE) * SLOT_SIZE * 4);
+        if (!pageSource(level, x, y, texels.data())) texels.clear();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.emplace_back(id, std::move(texels));
+    }
+}
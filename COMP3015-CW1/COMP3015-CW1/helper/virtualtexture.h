@@ -0,0 +1,159 @@
+#pragma once
+
+#include "texturedecoder.h"
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// A texture far larger than video memory, kept as fixed-size pages of
+// which only the ones the camera needs are resident.
+//
+// - Feedback: the ground is drawn at a fraction of the screen resolution
+//   with vt_feedback.frag, which flags every page it would sample in the
+//   request buffer (REQUEST_BINDING). The flags are copied into a mapped
+//   buffer and read a few frames later, once their fence has signalled.
+// - CPU cache: pages come from a PageSource, called on a worker thread,
+//   and are kept in an LRU cache of cachePages pages.
+// - Atlas: a fixed grid of page slots, each PAGE_SIZE texels plus a BORDER
+//   on every side for bilinear filtering. A few pages a frame are copied
+//   in from the cache, evicting the one least recently requested.
+// - Page table: one texel per page per level, bound at PAGE_TABLE_UNIT.
+//   A page that isn't resident points at its nearest resident ancestor,
+//   so the shader always finds something, only blurrier.
+//
+// Video memory is the atlas and the page table, whatever the virtual size.
+class VirtualTexture {
+public:
+    // Fills one page slot, SLOT_SIZE x SLOT_SIZE RGBA8 texels including the
+    // border, for a page of level 0 .. levelCount() - 1. Runs on the worker.
+    typedef std::function<bool(int level, int x, int y, unsigned char *rgba)> PageSource;
+
+    static const int PAGE_SIZE = 128;
+    static const int BORDER = 4;
+    static const int SLOT_SIZE = PAGE_SIZE + BORDER * 2;
+    static const int FEEDBACK_DIVISOR = 4;     // feedback is drawn at 1/4 of the screen size
+
+    static const GLuint PAGE_TABLE_UNIT = 4;
+    static const GLuint ATLAS_UNIT = 5;
+    static const GLuint REQUEST_BINDING = 6;
+
+    struct Stats {
+        int residentPages = 0;
+        int atlasPages = 0;
+        int cachedPages = 0;
+        int cachePages = 0;
+        int wantedPages = 0;        // requested but not resident yet
+        size_t loaded = 0;          // pages read from the source
+        size_t uploaded = 0;
+        size_t evicted = 0;         // from the atlas
+        size_t atlasBytes = 0;
+        double virtualBytes = 0.0;  // the whole chain as RGBA8
+    };
+
+    VirtualTexture() = default;
+
+    // Stops the worker and deletes the GL objects.
+    ~VirtualTexture();
+
+    // Make it non-copyable.
+    VirtualTexture(const VirtualTexture &) = delete;
+    VirtualTexture & operator=(const VirtualTexture &) = delete;
+
+    // virtualSize is texels across level 0, a power-of-two multiple of
+    // PAGE_SIZE. The atlas holds atlasPages x atlasPages pages. Needs a
+    // current context.
+    void init(int virtualSize, int atlasPages, int cachePages);
+
+    // Pages are requested before this is set, and loaded once it is.
+    void setSource(PageSource source);
+
+    // Tiles an uncompressed image across the whole virtual texture. Its
+    // size must be a power of two no larger than the virtual size.
+    static PageSource repeatImage(TextureDecoder::Result image);
+
+    // Around the feedback draw; the caller binds the program and draws.
+    // The framebuffer and viewport in use before are put back after.
+    void beginFeedback(int screenWidth, int screenHeight);
+    void endFeedback();
+
+    // Once per frame: reads finished feedback, takes pages from the worker
+    // and updates the atlas and page table.
+    void update();
+
+    int pagesAcross() const { return pages; }
+    int levelCount() const { return levels; }
+    const Stats &stats() const { return counters; }
+
+private:
+    struct CachedPage {
+        std::vector<unsigned char> texels;
+        std::list<int>::iterator age;
+    };
+
+    static const int READBACK_BUFFERS = 3;
+    int uploadsPerFrame = 8;
+
+    int pages = 0;                      // across level 0
+    int levels = 0;
+    int atlasPages = 0;
+    int cachePages = 0;
+    std::vector<int> levelFirst;        // page id of each level's first page
+
+    GLuint pageTable = 0;
+    GLuint atlas = 0;
+    GLuint requestBuffer = 0;
+    GLuint feedbackFbo = 0;
+    int feedbackWidth = 0;
+    int feedbackHeight = 0;
+    GLint savedFramebuffer = 0;
+    GLint savedViewport[4] = {};
+
+    GLuint readback[READBACK_BUFFERS] = {};
+    const GLuint *readbackMapped[READBACK_BUFFERS] = {};
+    GLsync readbackFence[READBACK_BUFFERS] = {};
+    int readbackNext = 0;
+
+    // Page ids are level-major: levelFirst[level] + y * across + x
+    std::vector<int> slotOfPage;        // atlas slot, -1 if not resident
+    std::vector<int> pageOfSlot;        // -1 if free
+    std::vector<uint32_t> lastUsed;     // feedback serial that last asked for it
+    uint32_t serial = 0;
+    std::vector<int> wanted;            // not resident, coarsest first
+    bool tableDirty = true;
+
+    // Render-thread LRU of loaded pages, most recent first
+    std::list<int> cacheAge;
+    std::unordered_map<int, CachedPage> cache;
+    std::unordered_set<int> loading;    // queued or running on the worker
+    std::unordered_set<int> failed;     // the source had nothing; not asked again
+
+    PageSource source;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> jobs;
+    std::vector<std::pair<int, std::vector<unsigned char>>> finished;
+    bool stopping = false;
+
+    Stats counters;
+
+    void pageCoords(int id, int &level, int &x, int &y) const;
+    void readFeedback(const GLuint *flags);
+    void takeFinished();
+    void queueLoads();
+    void uploadPages();
+    int freeSlot();
+    void rebuildPageTable();
+    void run();
+};
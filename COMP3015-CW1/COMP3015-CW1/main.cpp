@@ -1,10 +1,43 @@
 #include "helper/scene.h"
 #include "helper/scenerunner.h"
+#include "helper/objloader.h"
+#include "helper/meshopt.h"
+#include "helper/mipmap.h"
+#include "helper/texturedecoder.h"
+#include "helper/glslprogram.h"
 #include "scenebasic_uniform.h"
 
+#include <cstring>
 
 int main(int argc, char* argv[])
 {
+	// Benchmarks; --bench-obj and --bench-decode need no window, the others only its GL context
+	if (argc > 1 && strcmp(argv[1], "--bench-obj") == 0) {
+		ObjLoader::benchmark(argc > 2 ? argv[2] : "assets/Guard.obj");
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-decode") == 0) {
+		std::vector<std::string> files(argv + 2, argv + argc);
+		if (files.empty()) files = { "assets/wood.png", "assets/brick.jpg" };
+		TextureDecoder::benchmark(files);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-meshopt") == 0) {
+		SceneRunner runner("Mesh optimization benchmark");
+		MeshOpt::benchmarkDraw(argc > 2 ? argv[2] : "assets/Guard.obj");
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-textures") == 0) {
+		SceneRunner runner("Texture sampling benchmark");
+		MipMap::benchmarkSampling(argc > 2 ? argv[2] : "assets/wood.png");
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-uniforms") == 0) {
+		SceneRunner runner("Uniform update benchmark");
+		GLSLProgram::benchmarkUniforms();
+		return 0;
+	}
+
 	SceneRunner runner("Shader_Basics");
 
 	std::unique_ptr<Scene> scene;
@@ -13,4 +46,4 @@ int main(int argc, char* argv[])
 
 
 	return runner.run(*scene);
-}
\ No newline at end of file
+}
@@ -1,15 +1,23 @@
 ﻿#include "scenebasic_uniform.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <chrono>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <unordered_map>
 
 #include "helper/glutils.h"
+#include "helper/objloader.h"
+#include "helper/meshcache.h"
+#include "helper/meshopt.h"
+#include "helper/meshsimplify.h"
+#include "helper/bcencode.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -26,31 +34,69 @@ using glm::vec3;
 
 SceneBasic_Uniform::SceneBasic_Uniform() : angle(0.0f) {}
 
-static GLuint loadTexture2D(const char* path)
+// Where a texture's levels came from and what they cost
+static void printDecoded(const DecodedTexture& decoded)
 {
-    int w, h, n;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path, &w, &h, &n, 4);
-    if (!data) {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-        return 0;
+    const int w = decoded.width, h = decoded.height;
+    const char* formatName = decoded.compressed ? BC::name(decoded.format) : "RGBA8";
+    if (decoded.fromCache) {
+        printf("%s: %dx%d %s, %d levels, %.2f MB mapped from cache in %.1f ms\n", decoded.path.c_str(), w, h,
+               formatName, decoded.levelCount(), decoded.byteCount() / 1048576.0, decoded.decodeMs);
+    }
+    else {
+        printf("%s: %dx%d %s, %d levels, %.2f MB -> %.2f MB, decoded in %.1f ms\n", decoded.path.c_str(), w, h,
+               formatName, decoded.levelCount(), decoded.rawBytes / 1048576.0, decoded.byteCount() / 1048576.0,
+               decoded.decodeMs);
+    }
+}
+
+// Packs separate float arrays into PackedVertex and appends them to out.
+// bounds receives the dequantization transform.
+static void appendPacked(const float* pos, const float* norm, const float* uv, int count, PackBounds& bounds,
+                         std::vector<PackedVertex>& out)
+{
+    std::vector<ObjVertex> verts(count);
+    for (int i = 0; i < count; ++i) {
+        verts[i].pos = glm::vec3(pos[i * 3], pos[i * 3 + 1], pos[i * 3 + 2]);
+        verts[i].normal = glm::vec3(norm[i * 3], norm[i * 3 + 1], norm[i * 3 + 2]);
+        verts[i].uv = glm::vec2(uv[i * 2], uv[i * 2 + 1]);
     }
 
-    GLuint tex = 0;
-    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
-    glTextureStorage2D(tex, 1, GL_RGBA8, w, h);
-    glTextureSubImage2D(tex, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    std::vector<PackedVertex> packed;
+    VertexPack::pack(verts.data(), nullptr, verts.size(), packed, bounds);
+    out.insert(out.end(), packed.begin(), packed.end());
+}
 
-    // Filtering
-    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Level of detail for an object covering screenSize of the viewport height.
+// Below thresholds[i] level i+1 takes over. A level only changes once the
+// size is well past a threshold, so objects sitting on one don't flicker.
+static int selectLod(float screenSize, int current, const float* thresholds, int levelCount)
+{
+    const float margin = 0.15f;
+    int lod = std::min(std::max(current, 0), levelCount - 1);
+    while (lod + 1 < levelCount && screenSize < thresholds[lod] * (1.0f - margin)) ++lod;
+    while (lod > 0 && screenSize > thresholds[lod - 1] * (1.0f + margin)) --lod;
+    return lod;
+}
 
-    // Repeat 
-    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
+// Frustum planes from the combined matrix (Gribb/Hartmann), normalised
+static void frustumPlanes(const glm::mat4& viewProj, glm::vec4 frustum[6])
+{
+    for (int i = 0; i < 3; ++i) {
+        glm::vec4 row(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+        glm::vec4 w(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+        frustum[i * 2] = w + row;
+        frustum[i * 2 + 1] = w - row;
+    }
+    for (int i = 0; i < 6; ++i) frustum[i] /= glm::length(glm::vec3(frustum[i]));
+}
 
-    stbi_image_free(data);
-    return tex;
+static bool sphereVisible(const glm::vec4 frustum[6], const glm::vec3& center, float radius)
+{
+    for (int i = 0; i < 6; ++i) {
+        if (glm::dot(glm::vec3(frustum[i]), center) + frustum[i].w < -radius) return false;
+    }
+    return true;
 }
 
 void SceneBasic_Uniform::compileUI()
@@ -58,7 +104,7 @@ void SceneBasic_Uniform::compileUI()
     try {
         uiProg.compileShader("shader/ui_text.vert");
         uiProg.compileShader("shader/ui_text.frag");
-        uiProg.link();
+        uiProg.linkAsync();
     }
     catch (GLSLProgramException& e) {
         std::cerr << e.what() << std::endl;
@@ -158,24 +204,78 @@ void SceneBasic_Uniform::drawOverlay()
     pushText(tx, ty + 6 * lineH, l7);
     pushText(tx, ty + 7 * lineH, l8);
 
+    // Texture residency, top left
+    std::vector<std::string> stats;
+    char line[128];
+    const TextureTable::Stats& ts = textureTable.stats();
+    if (ts.budget > 0) {
+        snprintf(line, sizeof(line), "Textures: %d of %d resident, %.1f of %.0f MB", ts.resident, ts.slots,
+                 ts.bytes / 1048576.0, ts.budget / 1048576.0);
+    }
+    else if (textureTable.mode() == TextureTable::Array) {
+        snprintf(line, sizeof(line), "Textures: %d of %d resident, %.1f MB of arrays, not budgeted", ts.resident,
+                 ts.slots, ts.bytes / 1048576.0);
+    }
+    else {
+        snprintf(line, sizeof(line), "Textures: %d of %d resident, %.1f MB", ts.resident, ts.slots, ts.bytes / 1048576.0);
+    }
+    stats.push_back(line);
+    snprintf(line, sizeof(line), "Trimmed %d (%zu levels dropped), evicted %zu, reloaded %zu",
+             ts.trimmed, ts.trims, ts.evictions, ts.reloads);
+    stats.push_back(line);
+    if (virtualGround) {
+        const VirtualTexture::Stats& vs = groundTexture.stats();
+        snprintf(line, sizeof(line), "Ground pages: %d of %d, %d waiting, %zu evicted; %.1f MB for a %.0f MB texture",
+                 vs.residentPages, vs.atlasPages, vs.wantedPages, vs.evicted, vs.atlasBytes / 1048576.0,
+                 vs.virtualBytes / 1048576.0);
+        stats.push_back(line);
+    }
+    const TextureStreamer::Stats& ss = textureStreamer.stats();
+    if (ss.frames > 0) {
+        snprintf(line, sizeof(line), "Streamed %.2f MB over %d frames%s, at most %.0f KB a frame, %d waiting on the ring",
+                 ss.bytes / 1048576.0, ss.frames, textureStreamer.busy() ? " so far" : "",
+                 ss.peakFrameBytes / 1024.0, ss.stalledFrames);
+        stats.push_back(line);
+    }
+
+    // Counted since the last overlay, which makes one whole frame
+    GLSLProgram::UniformStats uniformTotals = shading.uniformStats();
+    for (const GLSLProgram* p : { &feedbackProg, &cullProg, &uiProg }) {
+        uniformTotals.issued += p->uniformStats().issued;
+        uniformTotals.elided += p->uniformStats().elided;
+    }
+    snprintf(line, sizeof(line), "Uniforms: %zu set, %zu skipped as unchanged",
+             uniformTotals.issued - lastUniformTotals.issued, uniformTotals.elided - lastUniformTotals.elided);
+    stats.push_back(line);
+    lastUniformTotals = uniformTotals;
+    snprintf(line, sizeof(line), "Shading variants: %d of %u compiled", shading.compiledCount(), shading.variantCount());
+    stats.push_back(line);
+
+    int statsW = 0;
+    for (const std::string& s : stats) statsW = std::max(statsW, stb_easy_font_width((char*)s.c_str()));
+    pushRect(pad, pad, float(statsW) + pad * 2.0f, float(lineH * (int)stats.size()) + pad * 2.0f);
+    for (size_t i = 0; i < stats.size(); ++i) {
+        pushText(pad * 2.0f, pad * 2.0f + float(i * lineH), stats[i]);
+    }
+
     // Render overlay
     glDisable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     uiProg.use();
-    uiProg.setUniform("uScreen", glm::vec2((float)width, (float)height));
+    uiUniforms.screen.set(glm::vec2((float)width, (float)height));
 
     glBindVertexArray(uiVao);
     glBindBuffer(GL_ARRAY_BUFFER, uiVbo);
 
     // draw panel
-    uiProg.setUniform("uColor", glm::vec4(0.0f, 0.0f, 0.0f, 0.45f));
+    uiUniforms.color.set(glm::vec4(0.0f, 0.0f, 0.0f, 0.45f));
     glBufferData(GL_ARRAY_BUFFER, uiRectVerts.size() * sizeof(float), uiRectVerts.data(), GL_DYNAMIC_DRAW);
     glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(uiRectVerts.size() / 2));
 
     // draw text
-    uiProg.setUniform("uColor", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+    uiUniforms.color.set(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
     glBufferData(GL_ARRAY_BUFFER, uiTextVerts.size() * sizeof(float), uiTextVerts.data(), GL_DYNAMIC_DRAW);
     glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(uiTextVerts.size() / 2));
 
@@ -185,206 +285,385 @@ void SceneBasic_Uniform::drawOverlay()
     glEnable(GL_DEPTH_TEST);
 }
 
-struct GuardVert {
-    glm::vec3 pos;
-    glm::vec3 normal;
-    glm::vec2 uv;
-};
+void SceneBasic_Uniform::initScene()
+{
+    loadStart = std::chrono::high_resolution_clock::now();
 
-static int FixIndex(int idx, int size) {
-    if (idx > 0) return idx - 1;
-    if (idx < 0) return size + idx;
-    return -1;
-}
+    compile();
+    compileUI();
 
-static bool ParseVVTVN(const std::string& s, int& vi, int& ti, int& ni) {
-    vi = ti = ni = 0;
+    // Depth testing for real 3D occlusion
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
 
-    size_t p1 = s.find('/');
-    if (p1 == std::string::npos) { 
-        vi = std::stoi(s);
-        return true;
+    glClearColor(0.62f, 0.70f, 0.85f, 1.0f);
+
+    // Lock mouse for FPS camera
+    if (window) {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     }
-    size_t p2 = s.find('/', p1 + 1);
-    if (p2 == std::string::npos) return false;
 
-    vi = std::stoi(s.substr(0, p1));
-    std::string t = s.substr(p1 + 1, p2 - (p1 + 1));
-    std::string n = s.substr(p2 + 1);
+    buildGround();
+    buildCube();
+    uploadStatic();
+
+    glCreateBuffers(1, &objectBuffer);
+    glNamedBufferStorage(objectBuffer, sizeof(ObjectData) * STATIC_OBJECTS, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, objectBuffer);
+
+    // Materials find their textures through the table, never a texture
+    // unit. SPIR-V for OpenGL has no bindless textures.
+    textureTable.init(bindlessTextures && !shading.usesSpirv(), 4, 1024);
+    textureTable.setBudget(textureBudget);
+    if (virtualGround) groundTexture.init(16384, 16, 512);
+
+    // Every shading variant gets these as it is first used; those without
+    // USE_TEXTURE have no such uniforms and ignore them
+    shading.onLinked([this](GLSLProgram& p) {
+        p.uniform<int>(BINDLESS_LOCATION).set(textureTable.mode() == TextureTable::Bindless ? 1 : 0);
+        if (virtualGround) {
+            // Ground UVs count repeats of the image; the virtual texture is 16 across
+            p.uniform<int>(VIRTUAL_PAGES_LOCATION).set(groundTexture.pagesAcross());
+            p.uniform<int>(VIRTUAL_LEVELS_LOCATION).set(groundTexture.levelCount());
+            p.uniform<float>(VIRTUAL_UV_SCALE_LOCATION).set(1.0f / 16.0f);
+        }
+    });
+
+    finishShaders();
+    if (virtualGround) {
+        feedbackProg.use();
+        feedbackProg.setUniform("uVirtualPages", groundTexture.pagesAcross());
+        feedbackProg.setUniform("uVirtualLevels", groundTexture.levelCount());
+        feedbackProg.setUniform("uVirtualUvScale", 1.0f / 16.0f);
+        feedbackProg.setUniform("uFeedbackLodBias", std::log2(float(VirtualTexture::FEEDBACK_DIVISOR)));
+    }
 
-    if (!t.empty()) ti = std::stoi(t);
-    if (!n.empty()) ni = std::stoi(n);
-    return true;
-}
+    initUI();
 
-static bool LoadGuardOBJ_ByMaterial(
-    const std::string& path,
-    std::unordered_map<std::string, std::vector<GuardVert>>& outByMtl
-) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open OBJ: " << path << "\n";
-        return false;
+    // initial projection
+    projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 0.1f, 200.0f);
+
+    // Everything below streams in behind placeholders
+    // Every image starts decoding at once on the decoder's threads and is
+    // streamed in, mip tail first, as each one finishes
+    TextureDecoder::Options texOptions;
+    texOptions.compress = compressTextures;
+    texOptions.s3tc = BC::supported(BC::BC1);
+    textureTable.adjust(texOptions);
+    std::shared_future<TextureDecoder::Result> brick = textureDecoder.decode("assets/brick.jpg", texOptions);
+    if (virtualGround) {
+        // Pages are cut from the plain RGBA8 chain, which has to tile a
+        // power-of-two size
+        TextureDecoder::Options groundOptions;
+        groundOptions.compress = false;
+        groundOptions.size = 1024;
+        std::shared_future<TextureDecoder::Result> wood = textureDecoder.decode("assets/wood.png", groundOptions);
+        loadInBackground([wood]() {
+            return wood.get() != nullptr;
+        }, [this, wood](bool ok) {
+            if (!ok) return;
+            printDecoded(*wood.get());
+            groundTexture.setSource(VirtualTexture::repeatImage(wood.get()));
+        });
     }
+    else {
+        loadTexture(textureDecoder.decode("assets/wood.png", texOptions), texOptions, &floorSlot);
+    }
+    loadTexture(brick, texOptions, &cubeSlot);
+
+    loadInBackground([this]() { return loadGuard(); }, [this](bool ok) {
+        if (!ok) exit(EXIT_FAILURE);
+        buildGuardVao();
+        guardReady = true;
+        printf("Guard ready after %.1f ms\n", msSinceLoadStart());
+    });
+}
 
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec2> texcoords;
-    std::vector<glm::vec3> normals;
+double SceneBasic_Uniform::msSinceLoadStart() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+}
+
+void SceneBasic_Uniform::loadInBackground(AssetLoader::Work work, AssetLoader::Ready ready)
+{
+    if (loader) {
+        loader->enqueue(std::move(work), std::move(ready));
+    }
+    else {
+        ready(work());
+    }
+}
 
-    std::string currentMtl = "default";
+void SceneBasic_Uniform::loadTexture(std::shared_future<TextureDecoder::Result> decoded,
+                                     const TextureDecoder::Options& options, int* slot)
+{
+    // The loader thread only waits for the decode; the upload is streamed
+    // from this thread, a slice per frame. options go with the texture so
+    // the table can reload it.
+    loadInBackground([decoded]() {
+        return decoded.get() != nullptr;
+    }, [this, decoded, options, slot](bool ok) {
+        if (!ok) return;
+        TextureDecoder::Result result = decoded.get();
+        printDecoded(*result);
+        *slot = textureTable.add(result, options, textureStreamer);
+        printf("%s ready after %.1f ms\n", result->path.c_str(), msSinceLoadStart());
+    });
+}
 
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line.empty()) continue;
+bool SceneBasic_Uniform::loadGuard()
+{
+    const char* objPath = "assets/Guard.obj";
+    const char* cachePath = "assets/Guard.meshcache";
 
-        std::istringstream ss(line);
-        std::string type;
-        ss >> type;
+    auto t0 = std::chrono::high_resolution_clock::now();
 
-        if (type == "v") {
-            glm::vec3 v{};
-            ss >> v.x >> v.y >> v.z;
-            positions.push_back(v);
-        }
-        else if (type == "vt") {
-            glm::vec2 t{};
-            ss >> t.x >> t.y;
-            t.y = 1.0f - t.y; 
-            texcoords.push_back(t);
-        }
-        else if (type == "vn") {
-            glm::vec3 n{};
-            ss >> n.x >> n.y >> n.z;
-            normals.push_back(n);
-        }
-        else if (type == "usemtl") {
-            ss >> currentMtl;
-            if (currentMtl.empty()) currentMtl = "default";
-        }
-        else if (type == "f") {
-            std::vector<std::string> face;
-            std::string tok;
-            while (ss >> tok) face.push_back(tok);
-            if (face.size() < 3) continue;
+    // Only the guard is culled, so its compute program loads with it
+    try {
+        cullProg.compileShader("shader/meshlet_cull.comp");
+        cullProg.link();
+
+        CullUniforms& u = cullUniforms;
+        u.firstMeshlet = cullProg.uniform<GLuint>("uFirstMeshlet");
+        u.meshletCount = cullProg.uniform<GLuint>("uMeshletCount");
+        u.model = cullProg.uniform<glm::mat4>("uModel");
+        u.modelScale = cullProg.uniform<float>("uModelScale");
+        u.camPos = cullProg.uniform<glm::vec3>("uCamPos");
+        u.frustum = cullProg.uniform<glm::vec4>("uFrustum");
+    }
+    catch (GLSLProgramException& e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
 
-            auto emit = [&](const std::string& vtx) {
-                int vi, ti, ni;
-                if (!ParseVVTVN(vtx, vi, ti, ni)) return;
+    // Cache key covers the OBJ and the MTL it references
+    std::vector<std::string> sources = { objPath };
+    std::string mtlPath = ObjLoader::findMtlLib(objPath);
+    if (!mtlPath.empty()) sources.push_back(mtlPath);
 
-                int p = FixIndex(vi, (int)positions.size());
-                int t = FixIndex(ti, (int)texcoords.size());
-                int n = FixIndex(ni, (int)normals.size());
+    uint64_t sourceHash = 0;
+    bool haveHash = MeshCache::hashSources(sources, sourceHash);
 
-                if (p < 0 || p >= (int)positions.size()) return;
+    // Warm start: map the processed model and upload it as it is
+    MeshCache cache;
+    if (haveHash && cache.open(cachePath, sourceHash)) {
+        const ObjModelView& view = cache.view();
+        uploadGuard(view, cache.buffers());
 
-                GuardVert gv{};
-                gv.pos = positions[p];
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        printf("Guard loaded: %zu vertices, %zu indices, %zu materials (mesh cache, %.1f ms)\n",
+               view.vertexCount, view.indexCount, view.materialCount, ms);
+        return true;
+    }
 
-                gv.uv = (t >= 0 && t < (int)texcoords.size()) ? texcoords[t] : glm::vec2(0.0f);
-                gv.normal = (n >= 0 && n < (int)normals.size()) ? normals[n] : glm::vec3(0, 1, 0);
+    ObjModel model;
+    if (!ObjLoader::loadModel(objPath, model)) {
+        std::cerr << "Failed to load " << objPath << "\n";
+        return false;
+    }
 
-                outByMtl[currentMtl].push_back(gv);
-                };
+    // Reorder for the post-transform cache, overdraw and fetch; the cache stores the result
+    MeshOpt::CacheStats before, after;
+    MeshOpt::optimizeModel(model, &before, &after);
+    size_t corners = model.indices.size();
+
+    static const float lodRatios[] = { 0.5f, 0.25f, 0.1f };
+    MeshSimplify::buildLods(model, lodRatios, 3);
+
+    // Packed whether or not compactVertices is set, so the cache serves both
+    MeshBuffers buffers;
+    VertexPack::pack(model.vertices.data(), model.vertexMaterials.data(), model.vertices.size(),
+                     buffers.packed, buffers.bounds);
+
+    // Meshlets per LOD. Building them regroups each LOD's triangles in
+    // place, so the index buffer uploaded and cached is the reordered one.
+    std::vector<ObjModel::Lod> levels = model.lods;
+    if (levels.empty()) levels.push_back({ 0, (uint32_t)model.indices.size(), 0.0f });
+    for (const ObjModel::Lod& level : levels) {
+        size_t first = buffers.meshlets.size();
+        Meshlets::build(model.indices.data(), level.firstIndex, level.indexCount, model.vertices.data(), buffers.meshlets);
+        buffers.lodMeshlets.push_back((uint32_t)(buffers.meshlets.size() - first));
+    }
 
-            // triangulate 
-            emit(face[0]); emit(face[1]); emit(face[2]);
-            if (face.size() == 4) { emit(face[0]); emit(face[2]); emit(face[3]); }
-        }
+    uploadGuard(ObjLoader::viewOf(model), { buffers.packed.data(), buffers.bounds, buffers.meshlets.data(),
+                                           buffers.meshlets.size(), buffers.lodMeshlets.data(), buffers.lodMeshlets.size() });
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    printf("Guard loaded: %zu vertices, %zu indices, %zu materials (parsed OBJ, %.1f ms)\n",
+           model.vertices.size(), model.indices.size(), model.materials.size(), ms);
+    if (!model.vertices.empty()) {
+        size_t unique = model.vertices.size();
+        printf("Guard vertices: %zu corners -> %zu unique (%.2fx dedup), "
+               "ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (16-entry FIFO)\n",
+               corners, unique, double(corners) / double(unique),
+               before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+    for (size_t i = 0; i < model.lods.size(); ++i) {
+        printf("Guard LOD %zu: %u triangles, error %.4f\n", i, model.lods[i].indexCount / 3, model.lods[i].error);
     }
+    printf("Guard meshlets:");
+    for (uint32_t count : buffers.lodMeshlets) printf(" %u", count);
+    printf(" (per LOD, <= %zu vertices / %zu triangles)\n", Meshlets::MAX_VERTICES, Meshlets::MAX_TRIANGLES);
 
+    if (!haveHash || !MeshCache::write(cachePath, sourceHash, model, buffers)) {
+        std::cerr << "Could not write mesh cache: " << cachePath << "\n";
+    }
     return true;
 }
 
-void SceneBasic_Uniform::initScene()
+void SceneBasic_Uniform::uploadGuard(const ObjModelView& model, const MeshBuffersView& buffers)
 {
-    compile();
-
-    // Depth testing for real 3D occlusion
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-
-    glClearColor(0.62f, 0.70f, 0.85f, 1.0f);
-
-    // Lock mouse for FPS camera
-    if (window) {
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // Material table, std430 layout matching basic_uniform.frag
+    struct GpuMaterial {
+        glm::vec4 kd;   // rgb = Kd, a = d
+        glm::vec4 ks;   // rgb = Ks, a = Ns
+    };
+    std::vector<GpuMaterial> materials;
+    for (size_t i = 0; i < model.materialCount; ++i) {
+        const ObjMaterial& m = model.materials[i];
+        materials.push_back({ glm::vec4(m.kd, m.d), glm::vec4(m.ks, m.ns) });
     }
+    if (materials.empty()) materials.push_back({ glm::vec4(1.0f), glm::vec4(0.0f) });
 
-    buildCube();
-    buildGround();
-
-    compileUI();
-    initUI();
+    glCreateBuffers(1, &guardMaterialBuffer);
+    glNamedBufferStorage(guardMaterialBuffer, materials.size() * sizeof(GpuMaterial), materials.data(), 0);
 
-    floorTex = loadTexture2D("assets/wood.png");
-    cubeTex = loadTexture2D("assets/brick.jpg");
-
-    // initial projection
-    projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 0.1f, 200.0f);
-
-    // GUARD: split OBJ by material
-    std::unordered_map<std::string, glm::vec3> kd = {
-        {"Botas",   glm::vec3(0.05f, 0.05f, 0.05f)},
-        {"Chaleco", glm::vec3(0.05f, 0.05f, 0.05f)},
-        {"Camisa",  glm::vec3(0.175139f, 0.383581f, 0.984887f)},
-        {"Piel",    glm::vec3(0.940392f, 0.457111f, 0.267475f)},
-        {"Vaquero", glm::vec3(0.026713f, 0.050565f, 0.119276f)}
-    };
-
-    std::unordered_map<std::string, std::vector<GuardVert>> byMtl;
+    if (compactVertices) {
+        // Material index rides in the packed vertex, so one buffer covers everything
+        guardBounds = buffers.bounds;
+        glCreateBuffers(1, &guardVbo);
+        glNamedBufferStorage(guardVbo, model.vertexCount * sizeof(PackedVertex), buffers.packed, 0);
+    }
+    else {
+        guardBounds = PackBounds();
 
-    guardParts.clear();
+        glCreateBuffers(1, &guardVbo);
+        glNamedBufferStorage(guardVbo, model.vertexCount * sizeof(ObjVertex), model.vertices, 0);
 
-    if (!LoadGuardOBJ_ByMaterial("assets/Guard.obj", byMtl)) {
-        std::cerr << "Failed to load assets/Guard.obj\n";
-        exit(1);
+        glCreateBuffers(1, &guardMaterialIdVbo);
+        glNamedBufferStorage(guardMaterialIdVbo, model.vertexCount * sizeof(uint16_t), model.vertexMaterials, 0);
     }
 
-    for (auto& kv : byMtl) {
-        const std::string& mtlName = kv.first;
-        auto& verts = kv.second;
-        if (verts.empty()) continue;
+    guardLods.clear();
+    for (size_t i = 0; i < model.lodCount; ++i) {
+        GuardLod lod;
+        lod.firstIndex = (int)model.lods[i].firstIndex;
+        lod.count = (int)model.lods[i].indexCount;
+        guardLods.push_back(lod);
+    }
+    if (guardLods.empty()) {
+        GuardLod lod;
+        lod.count = (int)model.indexCount;
+        guardLods.push_back(lod);
+    }
+    guardLod = 0;
+
+    // Bounding sphere for LOD selection
+    glm::vec3 lo(0.0f), hi(0.0f);
+    if (model.vertexCount > 0) lo = hi = model.vertices[0].pos;
+    for (size_t i = 1; i < model.vertexCount; ++i) {
+        lo = glm::min(lo, model.vertices[i].pos);
+        hi = glm::max(hi, model.vertices[i].pos);
+    }
+    guardCenter = (lo + hi) * 0.5f;
+    guardRadius = glm::length(hi - lo) * 0.5f;
+
+    // Meshlets were built level by level, finest first
+    int firstMeshlet = 0;
+    guardMaxMeshlets = 0;
+    for (size_t i = 0; i < guardLods.size() && i < buffers.levelCount; ++i) {
+        guardLods[i].firstMeshlet = firstMeshlet;
+        guardLods[i].meshletCount = (int)buffers.lodMeshlets[i];
+        firstMeshlet += guardLods[i].meshletCount;
+        guardMaxMeshlets = std::max(guardMaxMeshlets, guardLods[i].meshletCount);
+    }
 
-        GuardPart part;
-        part.count = (int)verts.size();
+    // 16-bit indices when every vertex is addressable; the cache has them so already
+    glCreateBuffers(1, &guardEbo);
+    if (model.indexSize == 2) {
+        glNamedBufferStorage(guardEbo, std::max<size_t>(model.indexCount, 1) * sizeof(GLushort), model.indices, 0);
+        guardIndexType = GL_UNSIGNED_SHORT;
+    }
+    else if (model.vertexCount <= 0x10000) {
+        const uint32_t* indices = (const uint32_t*)model.indices;
+        std::vector<GLushort> shortIdx(indices, indices + model.indexCount);
+        glNamedBufferStorage(guardEbo, std::max<size_t>(shortIdx.size(), 1) * sizeof(GLushort), shortIdx.data(), 0);
+        guardIndexType = GL_UNSIGNED_SHORT;
+    }
+    else {
+        glNamedBufferStorage(guardEbo, model.indexCount * sizeof(GLuint), model.indices, 0);
+        guardIndexType = GL_UNSIGNED_INT;
+    }
 
-        auto it = kd.find(mtlName);
-        part.kd = (it != kd.end()) ? it->second : glm::vec3(1.0f);
+    glCreateBuffers(1, &guardMeshletBuffer);
+    if (buffers.meshletCount > 0) {
+        glNamedBufferStorage(guardMeshletBuffer, buffers.meshletCount * sizeof(Meshlet), buffers.meshlets, 0);
+    }
+    else {
+        const Meshlet empty = Meshlet();
+        glNamedBufferStorage(guardMeshletBuffer, sizeof(Meshlet), &empty, 0);
+    }
 
-        glGenVertexArrays(1, &part.vao);
-        glBindVertexArray(part.vao);
+    // DrawElementsIndirectCommand is five uints
+    glCreateBuffers(1, &guardCommandBuffer);
+    glNamedBufferStorage(guardCommandBuffer, std::max(guardMaxMeshlets, 1) * 5 * sizeof(GLuint), nullptr, 0);
+    glCreateBuffers(1, &guardDrawCountBuffer);
+    glNamedBufferStorage(guardDrawCountBuffer, sizeof(GLuint), nullptr, 0);
+}
 
-        glGenBuffers(1, &part.vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, part.vbo);
-        glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GuardVert), verts.data(), GL_STATIC_DRAW);
+void SceneBasic_Uniform::buildGuardVao()
+{
+    glGenVertexArrays(1, &guardVao);
+    glBindVertexArray(guardVao);
 
+    glBindBuffer(GL_ARRAY_BUFFER, guardVbo);
+    if (compactVertices) {
+        VertexPack::setAttribPointers();
+    }
+    else {
         // layout 0: position
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GuardVert), (void*)offsetof(GuardVert, pos));
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, pos));
 
         // layout 1: normal
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GuardVert), (void*)offsetof(GuardVert, normal));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, normal));
 
-        // layout 2: uv 
+        // layout 2: uv
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GuardVert), (void*)offsetof(GuardVert, uv));
-
-        glBindVertexArray(0);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (void*)offsetof(ObjVertex, uv));
 
-        guardParts.push_back(part);
+        // layout 3: material index
+        glBindBuffer(GL_ARRAY_BUFFER, guardMaterialIdVbo);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, sizeof(uint16_t), (void*)0);
     }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, guardEbo);
 
-    std::cout << "Guard parts loaded: " << guardParts.size() << "\n";
+    glBindVertexArray(0);
 }
 
 void SceneBasic_Uniform::compile()
 {
+    // Programs are only submitted here; finishShaders() collects them
+    // once the rest of the scene is set up
+    bool parallel = GLSLProgram::enableParallelCompile();
+    printf("Shading variants: %s\n", shading.usesSpirv() ? "specialized from SPIR-V" : "compiled from GLSL");
     try {
-        prog.compileShader("shader/basic_uniform.vert");
-        prog.compileShader("shader/basic_uniform.frag");
-        prog.link();
-        prog.use();
+        // The variants the first frame draws with. The driver can build the
+        // rest alongside when it compiles in parallel; otherwise each waits
+        // for its toggle, and is compiled then, or loaded from the cache.
+        shading.submit(shadingKey(true));
+        shading.submit(shadingKey(false));
+        if (parallel) {
+            for (unsigned key = 0; key < shading.variantCount(); ++key) shading.submit(key);
+        }
+
+        if (virtualGround) {
+            feedbackProg.compileShader("shader/basic_uniform.vert");
+            feedbackProg.compileShader("shader/vt_feedback.frag");
+            feedbackProg.linkAsync();
+        }
     }
     catch (GLSLProgramException& e) {
         std::cerr << e.what() << std::endl;
@@ -392,6 +671,61 @@ void SceneBasic_Uniform::compile()
     }
 }
 
+void SceneBasic_Uniform::finishShaders()
+{
+    std::vector<GLSLProgram*> waiting = { &shading.submit(shadingKey(true)), &shading.submit(shadingKey(false)), &uiProg };
+    if (virtualGround) waiting.push_back(&feedbackProg);
+    int total = (int)waiting.size();
+    int cached = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+
+    // Errors are reported for whichever program the driver finishes first
+    try {
+        while (!waiting.empty()) {
+            for (size_t i = 0; i < waiting.size(); ) {
+                if (!waiting[i]->isLinkDone()) {
+                    ++i;
+                    continue;
+                }
+                waiting[i]->finishLink();
+                if (waiting[i]->isFromBinary()) ++cached;
+                waiting.erase(waiting.begin() + i);
+            }
+            if (!waiting.empty()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        resolveUniforms();
+    }
+    catch (GLSLProgramException& e) {
+        std::cerr << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    double waited = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    printf("Shaders ready after %.1f ms, %.1f ms of it waiting (%d of %d programs from binary cache)\n",
+           msSinceLoadStart(), waited, cached, total);
+}
+
+unsigned SceneBasic_Uniform::shadingKey(bool textured) const
+{
+    return (textured ? SHADE_TEXTURE : 0) | (spotlightMode ? SHADE_SPOTLIGHT : 0) | (fogMode ? SHADE_FOG : 0);
+}
+
+GLSLProgram& SceneBasic_Uniform::shadingProgram(bool textured)
+{
+    try {
+        return shading.get(shadingKey(textured));
+    }
+    catch (GLSLProgramException& e) {
+        std::cerr << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void SceneBasic_Uniform::resolveUniforms()
+{
+    uiUniforms.screen = uiProg.uniform<glm::vec2>("uScreen");
+    uiUniforms.color = uiProg.uniform<glm::vec4>("uColor");
+}
+
 void SceneBasic_Uniform::buildCube()
 {
     // 36 vertices cube
@@ -440,49 +774,7 @@ void SceneBasic_Uniform::buildCube()
         0,0, 1,0, 1,1, 0,0, 1,1, 0,1
     };
 
-    GLuint vbo[3];
-    glGenBuffers(3, vbo);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(positionData), positionData, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normalData), normalData, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(uvData), uvData, GL_STATIC_DRAW);
-
-    glGenVertexArrays(1, &cubeVao);
-    glBindVertexArray(cubeVao);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-#ifdef __APPLE__
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLubyte*)NULL);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLubyte*)NULL);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLubyte*)NULL);
-#else
-    glBindVertexBuffer(0, vbo[0], 0, sizeof(float) * 3);
-    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexAttribBinding(0, 0);
-
-    glBindVertexBuffer(1, vbo[1], 0, sizeof(float) * 3);
-    glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexAttribBinding(1, 1);
-
-    glBindVertexBuffer(2, vbo[2], 0, sizeof(float) * 2);
-    glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, 0);
-    glVertexAttribBinding(2, 2);
-#endif
-
-    glBindVertexArray(0);
+    cubeFirst = addStaticMesh(positionData, normalData, uvData, 36, cubeBounds);
 }
 
 void SceneBasic_Uniform::buildGround()
@@ -502,20 +794,52 @@ void SceneBasic_Uniform::buildGround()
         0,0, 10,10, 0,10
     };
 
+    groundFirst = addStaticMesh(groundPos, groundNorm, groundUV, 6, groundBounds);
+}
+
+int SceneBasic_Uniform::addStaticMesh(const float* pos, const float* norm, const float* uv, int count, PackBounds& bounds)
+{
+    int first = staticVertexCount;
+    staticVertexCount += count;
+    if (compactVertices) {
+        appendPacked(pos, norm, uv, count, bounds, staticPacked);
+    }
+    else {
+        staticPos.insert(staticPos.end(), pos, pos + count * 3);
+        staticNorm.insert(staticNorm.end(), norm, norm + count * 3);
+        staticUV.insert(staticUV.end(), uv, uv + count * 2);
+    }
+    return first;
+}
+
+void SceneBasic_Uniform::uploadStatic()
+{
+    glGenVertexArrays(1, &staticVao);
+    glBindVertexArray(staticVao);
+
+    if (compactVertices) {
+        GLuint vbo = 0;
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, staticPacked.size() * sizeof(PackedVertex), staticPacked.data(), GL_STATIC_DRAW);
+        VertexPack::setAttribPointers();
+
+        glBindVertexArray(0);
+        std::vector<PackedVertex>().swap(staticPacked);
+        return;
+    }
+
     GLuint vbo[3];
     glGenBuffers(3, vbo);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(groundPos), groundPos, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, staticPos.size() * sizeof(float), staticPos.data(), GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(groundNorm), groundNorm, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, staticNorm.size() * sizeof(float), staticNorm.data(), GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(groundUV), groundUV, GL_STATIC_DRAW);
-
-    glGenVertexArrays(1, &groundVao);
-    glBindVertexArray(groundVao);
+    glBufferData(GL_ARRAY_BUFFER, staticUV.size() * sizeof(float), staticUV.data(), GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
@@ -545,6 +869,9 @@ void SceneBasic_Uniform::buildGround()
 #endif
 
     glBindVertexArray(0);
+    std::vector<float>().swap(staticPos);
+    std::vector<float>().swap(staticNorm);
+    std::vector<float>().swap(staticUV);
 }
 
 void SceneBasic_Uniform::update(float t)
@@ -631,6 +958,10 @@ void SceneBasic_Uniform::update(float t)
 
 void SceneBasic_Uniform::render()
 {
+    textureTable.update(textureDecoder, textureStreamer);
+    textureStreamer.update();
+    if (virtualGround) groundTexture.update();
+
     if (isDarkMode) {
         glClearColor(0.03f, 0.03f, 0.05f, 1.0f); // dark sky
     }
@@ -640,114 +971,172 @@ void SceneBasic_Uniform::render()
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    prog.use();
-
-    // Lighting uniforms
-    if (isDarkMode) {
-        prog.setUniform("uLightColor", glm::vec3(0.9f, 0.9f, 1.0f));
-        prog.setUniform("uAmbientStrength", 0.06f);
-        prog.setUniform("uSpecStrength", 0.75f);
-    }
-    else {
-        prog.setUniform("uLightColor", glm::vec3(2.5f, 2.5f, 2.5f));
-        prog.setUniform("uAmbientStrength", 0.30f);
-        prog.setUniform("uSpecStrength", 0.65f);
-    }
-
-    prog.setUniform("uViewPos", camPos);
-    prog.setUniform("uLightPos", lightPos);
-    prog.setUniform("uLightColor", glm::vec3(1.2f, 1.0f, 0.85f));
-
-    prog.setUniform("uShininess", 64.0f);
-
-    // View/proj uniforms
-    prog.setUniform("uView", view);
-    prog.setUniform("uProj", projection);
-    prog.setUniform("uFog", fogMode ? 1 : 0);
-
-    prog.setUniform("uUseSpotlight", spotlightMode ? 1 : 0);
-
-    // Make spotlight act like a flashlight from the camera
+    // A variant seen for the first time is compiled here, or loaded from
+    // the binary cache
+    GLSLProgram& texturedProg = shadingProgram(true);
+    GLSLProgram& plainProg = shadingProgram(false);
+    uniformRing.beginFrame();
+
+    // Everything the shaders light and fog by, in one block. The light
+    // colour is the same in both modes; ambient and fog follow the sky.
+    FrameBlock frame;
+    frame.view = view;
+    frame.proj = projection;
+    frame.viewPos = glm::vec4(camPos, 1.0f);
+    frame.lightColor = glm::vec4(1.2f, 1.0f, 0.85f, isDarkMode ? 0.06f : 0.30f);
+    frame.fogColor = isDarkMode ? glm::vec4(0.05f, 0.05f, 0.08f, 1.0f) : glm::vec4(0.62f, 0.70f, 0.85f, 1.0f);
+    frame.params = glm::vec4(glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(18.0f)), 6.0f, 25.0f);
     if (spotlightMode) {
-        prog.setUniform("uLightPos", camPos);
-        prog.setUniform("uSpotDir", camFront);
-
-        // inner/outer angles (degrees)
-        float inner = glm::cos(glm::radians(12.5f));
-        float outer = glm::cos(glm::radians(18.0f));
-        prog.setUniform("uInnerCutoff", inner);
-        prog.setUniform("uOuterCutoff", outer);
+        // A flashlight held at the camera
+        frame.lightPos = glm::vec4(camPos, 1.0f);
+        frame.spotDir = glm::vec4(camFront, 0.0f);
     }
     else {
-        // Normal mode: keep your orbiting point light
-        prog.setUniform("uLightPos", lightPos);
-
-        // Still set something valid
-        prog.setUniform("uSpotDir", glm::vec3(0.0f, -1.0f, 0.0f));
-        prog.setUniform("uInnerCutoff", glm::cos(glm::radians(12.5f)));
-        prog.setUniform("uOuterCutoff", glm::cos(glm::radians(18.0f)));
+        // The orbiting point light; the spot direction is unused but valid
+        frame.lightPos = glm::vec4(lightPos, 1.0f);
+        frame.spotDir = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
     }
-
-    // Fog settings
-    if (isDarkMode) {
-        prog.setUniform("uFogColor", glm::vec3(0.05f, 0.05f, 0.08f));
-    }
-    else {
-        prog.setUniform("uFogColor", glm::vec3(0.62f, 0.70f, 0.85f));
+    uniformRing.bind(FRAME_BLOCK, frame);
+
+    // The scene's own surfaces, then the guard's MTL materials
+    MaterialParams plainMaterial;
+    plainMaterial.specular = glm::vec4(isDarkMode ? 0.75f : 0.65f, 64.0f, 0.0f, 0.0f);
+    plainMaterial.flags = glm::ivec4(0);
+    MaterialParams mtlMaterial = plainMaterial;
+    mtlMaterial.flags.x = 1;
+
+    // Ground and cube in one draw, each reading its transform, colour and
+    // texture slot from the object buffer by gl_DrawID. An object whose
+    // texture is still loading shows its base colour.
+    ObjectData objects[STATIC_OBJECTS];
+    objects[0].model = glm::mat4(1.0f);
+    objects[0].posScale = glm::vec4(groundBounds.scale, 0.0f);
+    objects[0].posOffset = glm::vec4(groundBounds.offset, 0.0f);
+    objects[0].baseColor = glm::vec4(0.28f, 0.30f, 0.28f, 1.0f);
+    objects[0].texture = virtualGround ? glm::ivec4(-1, 1, 0, 0) : glm::ivec4(floorSlot, 0, 0, 0);
+
+    objects[1].model = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 0.0f, 0.0f));
+    objects[1].posScale = glm::vec4(cubeBounds.scale, 0.0f);
+    objects[1].posOffset = glm::vec4(cubeBounds.offset, 0.0f);
+    objects[1].baseColor = glm::vec4(0.80f, 0.80f, 0.86f, 1.0f);
+    objects[1].texture = glm::ivec4(cubeSlot, 0, 0, 0);
+
+    glNamedBufferSubData(objectBuffer, 0, sizeof(objects), objects);
+
+    // Textures of objects in view stay resident, or come back
+    glm::vec4 frustum[6];
+    frustumPlanes(projection * view, frustum);
+    if (sphereVisible(frustum, glm::vec3(0.0f, -0.5f, 0.0f), 14.2f)) textureTable.touch(floorSlot);
+    if (sphereVisible(frustum, glm::vec3(3.0f, 0.0f, 0.0f), 0.87f)) textureTable.touch(cubeSlot);
+
+    if (virtualGround) {
+        // Which ground pages this view samples; read back a few frames on
+        groundTexture.beginFeedback(width, height);
+        feedbackProg.use();
+        ObjectParams batched;
+        batched.flags = glm::ivec4(1, 0, 0, 0);
+        uniformRing.bind(OBJECT_BLOCK, batched);
+        glBindVertexArray(staticVao);
+        glDrawArrays(GL_TRIANGLES, groundFirst, 6);
+        glBindVertexArray(0);
+        groundTexture.endFeedback();
     }
-    prog.setUniform("uFogNear", 6.0f);
-    prog.setUniform("uFogFar", 25.0f);
-
-    // Ground uses texture
-    prog.setUniform("uUseTexture", 1);
-    prog.setUniform("uTex", 0);
-
-    glBindTextureUnit(0, floorTex);
 
-    // Draw ground
-    glm::mat4 groundModel(1.0f);
-    prog.setUniform("uModel", groundModel);
-    prog.setUniform("uBaseColor", glm::vec3(0.28f, 0.30f, 0.28f));
-
-    glBindVertexArray(groundVao);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-	// Cube texture
-    prog.setUniform("uUseTexture", 1);
-    prog.setUniform("uTex", 0);
-    glBindTextureUnit(0, cubeTex);
-
-    // Draw cube 
-    glm::mat4 cubeModel(1.0f);
-    cubeModel = glm::translate(cubeModel, glm::vec3(3.0f, 0.0f, 0.0f));
-    prog.setUniform("uModel", cubeModel);
-    prog.setUniform("uBaseColor", glm::vec3(0.80f, 0.80f, 0.86f));
-
-    glBindVertexArray(cubeVao);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    const GLint firsts[STATIC_OBJECTS] = { groundFirst, cubeFirst };
+    const GLsizei counts[STATIC_OBJECTS] = { 6, 36 };
+    ObjectParams batched;
+    batched.flags = glm::ivec4(1, 0, 0, 0);
+    uniformRing.bind(MATERIAL_BLOCK, plainMaterial);
+    uniformRing.bind(OBJECT_BLOCK, batched);
+    texturedProg.use();
+    glBindVertexArray(staticVao);
+    glMultiDrawArrays(GL_TRIANGLES, firsts, counts, STATIC_OBJECTS);
     glBindVertexArray(0);
 
-    // Draw Guard first using the 3D shader
-    prog.use(); 
-
-    prog.setUniform("uUseTexture", 0);
-
+    // Draw Guard: visible meshlets of one LOD, colours from the material SSBO
     glm::mat4 guardModel(1.0f);
     guardModel = glm::translate(guardModel, glm::vec3(0.0f, 0.0f, 0.0f));
     guardModel = glm::scale(guardModel, glm::vec3(1.5f));
-    prog.setUniform("uModel", guardModel);
-
-    for (auto& part : guardParts) {
-        prog.setUniform("uBaseColor", part.kd);
-        glBindVertexArray(part.vao);
-        glDrawArrays(GL_TRIANGLES, 0, part.count);
+    float guardScale = glm::length(glm::vec3(guardModel[0]));
+
+    if (!guardReady) {
+        // Proxy box, roughly the guard's object-space extent
+        glm::mat4 proxyModel = glm::translate(guardModel, glm::vec3(0.0f, 0.57f, 0.28f));
+        proxyModel = glm::scale(proxyModel, glm::vec3(0.8f, 1.8f, 0.85f));
+        ObjectParams proxy;
+        proxy.model = proxyModel;
+        proxy.posScale = glm::vec4(cubeBounds.scale, 0.0f);
+        proxy.posOffset = glm::vec4(cubeBounds.offset, 0.0f);
+        proxy.baseColor = glm::vec4(0.45f, 0.45f, 0.50f, 1.0f);
+        proxy.flags = glm::ivec4(0);
+        uniformRing.bind(OBJECT_BLOCK, proxy);
+
+        plainProg.use();
+        glBindVertexArray(staticVao);
+        glDrawArrays(GL_TRIANGLES, cubeFirst, 36);
+        glBindVertexArray(0);
+    }
+    else {
+        // Projected diameter of the bounding sphere as a fraction of the viewport height
+        static const float lodThresholds[] = { 0.5f, 0.25f, 0.1f };
+        glm::vec3 center = glm::vec3(guardModel * glm::vec4(guardCenter, 1.0f));
+        float radius = guardRadius * guardScale;
+        float dist = std::max(glm::length(center - camPos), 1e-3f);
+        float screenSize = radius * projection[1][1] / dist;
+        int levels = std::min((int)guardLods.size(), 4);
+        guardLod = selectLod(screenSize, guardLod, lodThresholds, levels);
+
+        const GuardLod& lod = guardLods[guardLod];
+
+        cullProg.use();
+        cullUniforms.firstMeshlet.set((GLuint)lod.firstMeshlet);
+        cullUniforms.meshletCount.set((GLuint)lod.meshletCount);
+        cullUniforms.model.set(guardModel);
+        cullUniforms.modelScale.set(guardScale);
+        cullUniforms.camPos.set(camPos);
+        cullUniforms.frustum.set(frustum, 6);
+
+        glClearNamedBufferSubData(guardDrawCountBuffer, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, guardMeshletBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, guardCommandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, guardDrawCountBuffer);
+        glDispatchCompute((lod.meshletCount + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+        plainProg.use();
+
+        ObjectParams guard;
+        guard.model = guardModel;
+        guard.posScale = glm::vec4(guardBounds.scale, 0.0f);
+        guard.posOffset = glm::vec4(guardBounds.offset, 0.0f);
+        guard.baseColor = glm::vec4(0.0f);
+        guard.flags = glm::ivec4(0);
+        uniformRing.bind(MATERIAL_BLOCK, mtlMaterial);
+        uniformRing.bind(OBJECT_BLOCK, guard);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, guardMaterialBuffer);
+        glBindVertexArray(guardVao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, guardCommandBuffer);
+        glBindBuffer(GL_PARAMETER_BUFFER, guardDrawCountBuffer);
+
+        // Cone culling assumes back faces are never seen, so cull them in raster too
+        glEnable(GL_CULL_FACE);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, guardIndexType, nullptr, 0, lod.meshletCount, 0);
+        glDisable(GL_CULL_FACE);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        glBindVertexArray(0);
     }
 
-    glBindVertexArray(0);
-    glDrawArrays(GL_TRIANGLES, 0, guardVertexCount);
-    glBindVertexArray(0);
+    uniformRing.endFrame();
 
     drawOverlay();
+
+    if (!firstFrameDrawn) {
+        firstFrameDrawn = true;
+        printf("First frame after %.1f ms\n", msSinceLoadStart());
+    }
 }
 
 void SceneBasic_Uniform::resize(int w, int h)
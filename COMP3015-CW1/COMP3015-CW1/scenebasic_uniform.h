@@ -1,17 +1,92 @@
-#pragma once
+﻿#pragma once
 
 #include "helper/scene.h"
 #include "helper/glslprogram.h"
+#include "helper/shadervariants.h"
+#include "helper/objloader.h"
+#include "helper/meshcache.h"
+#include "helper/vertexpack.h"
+#include "helper/meshlet.h"
+#include "helper/assetloader.h"
+#include "helper/texturedecoder.h"
+#include "helper/texturestreamer.h"
+#include "helper/texturetable.h"
+#include "helper/virtualtexture.h"
+#include "helper/uniformring.h"
 
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <vector>
 #include <string>
 
 class SceneBasic_Uniform : public Scene
 {
 private:
-    GLSLProgram prog;
+    // basic_uniform, one program per ShadingFeature combination; draws
+    // take the one for the current toggles, see shadingProgram
+    enum ShadingFeature {
+        SHADE_TEXTURE = 1 << 0,     // something in the draw may be textured
+        SHADE_SPOTLIGHT = 1 << 1,
+        SHADE_FOG = 1 << 2,
+    };
+    ShaderVariants shading{ { "shader/basic_uniform.vert", "shader/basic_uniform.frag" },
+                            { "USE_TEXTURE", "USE_SPOTLIGHT", "USE_FOG" } };
+    unsigned shadingKey(bool textured) const;
+    // basic_uniform.frag's explicit uniform locations, which a program
+    // from SPIR-V can only be reached by; its samplers are bound in the
+    // shader to TextureTable's and VirtualTexture's units
+    static const GLint BINDLESS_LOCATION = 0;
+    static const GLint VIRTUAL_PAGES_LOCATION = 1;
+    static const GLint VIRTUAL_LEVELS_LOCATION = 2;
+    static const GLint VIRTUAL_UV_SCALE_LOCATION = 3;
+    GLSLProgram& shadingProgram(bool textured);
+    GLSLProgram cullProg;       // meshlet culling compute shader
+
+    // Uniforms of the programs without blocks, as handles resolved once
+    // each has linked; one-off settings at startup still go by name
+    struct CullUniforms {
+        Uniform<GLuint> firstMeshlet, meshletCount;
+        Uniform<glm::mat4> model;
+        Uniform<float> modelScale;
+        Uniform<glm::vec3> camPos;
+        Uniform<glm::vec4> frustum;
+    } cullUniforms;
+    struct UiUniforms {
+        Uniform<glm::vec2> screen;
+        Uniform<glm::vec4> color;
+    } uiUniforms;
+    void resolveUniforms();
+    GLSLProgram::UniformStats lastUniformTotals;    // for the overlay's per-frame counts
+
+    // basic_uniform's uniform blocks, std140 as declared there. Each frame
+    // writes them to the ring: the frame block once, then a material and
+    // an object block per draw that changes them.
+    struct FrameBlock {
+        glm::mat4 view;
+        glm::mat4 proj;
+        glm::vec4 viewPos;
+        glm::vec4 lightPos;
+        glm::vec4 lightColor;       // a = ambient strength
+        glm::vec4 spotDir;
+        glm::vec4 fogColor;
+        glm::vec4 params;           // spotlight inner, outer cos; fog near, far
+    };
+    struct MaterialParams {
+        glm::vec4 specular;         // x = strength, y = shininess
+        glm::ivec4 flags;           // x = 1 for the MTL material buffer
+    };
+    struct ObjectParams {
+        glm::mat4 model;
+        glm::vec4 posScale;
+        glm::vec4 posOffset;
+        glm::vec4 baseColor;
+        glm::ivec4 flags;           // x = 1 to read the object buffer by gl_DrawID
+    };
+    static const GLuint FRAME_BLOCK = 0;
+    static const GLuint MATERIAL_BLOCK = 1;
+    static const GLuint OBJECT_BLOCK = 2;
+    UniformRing uniformRing;
 
     GLSLProgram uiProg;
     GLuint uiVao = 0;
@@ -26,12 +101,76 @@ private:
     void pushText(float x, float y, const std::string& text);
     void drawOverlay();
 
-    GLuint cubeVao = 0;
-    GLuint groundVao = 0;
+    // Meshes use the 16-byte PackedVertex layout; false keeps the
+    // original float attributes for comparing the two.
+    bool compactVertices = true;
+
+    // Ground and cube share one vertex buffer and go in one multi-draw;
+    // their per-draw data is ObjectData, as in basic_uniform.vert
+    struct ObjectData {
+        glm::mat4 model;
+        glm::vec4 posScale;
+        glm::vec4 posOffset;
+        glm::vec4 baseColor;
+        glm::ivec4 texture;     // x = texture slot, -1 for none
+    };
+    static const int STATIC_OBJECTS = 2;
+
+    GLuint staticVao = 0;
+    GLuint objectBuffer = 0;        // SSBO, binding 5
+    int groundFirst = 0;
+    int cubeFirst = 0;
+    PackBounds cubeBounds;
+    PackBounds groundBounds;
+
+    // Staging for uploadStatic()
+    int staticVertexCount = 0;
+    std::vector<PackedVertex> staticPacked;
+    std::vector<float> staticPos, staticNorm, staticUV;
+    int addStaticMesh(const float* pos, const float* norm, const float* uv, int count, PackBounds& bounds);
+    void uploadStatic();
+
+    // Textures are block-compressed (BC1/BC7) and cached as .dds beside
+    // the source; false uploads plain RGBA8, cached as .rgba8.dds.
+    bool compressTextures = true;
+
+    // Video memory bindless material textures may use before the least
+    // recently seen are trimmed or evicted; 0 for no limit. Texture arrays
+    // are allocated whole and not budgeted.
+    size_t textureBudget = 64 * 1024 * 1024;
+
+    // Materials reach textures through bindless handles where available,
+    // otherwise as layers of one array; false always uses the array.
+    bool bindlessTextures = true;
+
+    // Texture table slots; -1 until the background load finishes, drawn
+    // in a flat colour until then
+    int floorSlot = -1;
 
-    GLuint floorTex = 0;
+    int cubeSlot = -1;
 
-    GLuint cubeTex = 0;
+    // The ground samples a virtual texture, the wood repeated across
+    // 16384 x 16384 and paged in as the camera needs it; false gives it a
+    // table slot like the cube.
+    bool virtualGround = true;
+    VirtualTexture groundTexture;
+    GLSLProgram feedbackProg;       // marks the ground pages in view
+
+    // Time to first frame and to each asset, measured from initScene
+    std::chrono::high_resolution_clock::time_point loadStart;
+    bool firstFrameDrawn = false;
+    double msSinceLoadStart() const;
+
+    // Runs work on the loader thread and ready on this one once its GL
+    // objects are usable; both in place when there is no loader.
+    void loadInBackground(AssetLoader::Work work, AssetLoader::Ready ready);
+    void loadTexture(std::shared_future<TextureDecoder::Result> decoded, const TextureDecoder::Options& options, int* slot);
+
+    // Decodes, mips and compresses images off both the render and loader threads
+    TextureDecoder textureDecoder;
+    // Uploads them through a PBO ring within a per-frame byte budget
+    TextureStreamer textureStreamer;
+    TextureTable textureTable;
 
     float angle = 0.0f;
 
@@ -62,19 +201,52 @@ private:
     bool fPressed = false;
 
     void compile();
+    void finishShaders();
     void buildCube();
     void buildGround();
 
     glm::vec3 lightPos = glm::vec3(0.0f, -100.0f, 0.0f);
 
-    struct GuardPart {
-        GLuint vao = 0;
-        GLuint vbo = 0;
+    // All guard materials share one VAO and draw in a single call; each
+    // vertex carries its material index.
+
+    // A proxy box stands in until the loader hands the guard over
+    bool guardReady = false;
+
+    GLuint guardVao = 0;
+    GLuint guardVbo = 0;
+    GLuint guardMaterialIdVbo = 0;          // float layout only
+    GLuint guardEbo = 0;
+    GLuint guardMaterialBuffer = 0;         // SSBO, binding 0
+    GLenum guardIndexType = GL_UNSIGNED_INT;    // GL_UNSIGNED_SHORT when it fits
+    PackBounds guardBounds;
+
+    // Detail levels share the guard's vertices; each is one index range.
+    // The level is picked from the guard's projected size every frame.
+    struct GuardLod {
+        int firstIndex = 0;
         int count = 0;
-        glm::vec3 kd = glm::vec3(1.0f);
+        int firstMeshlet = 0;
+        int meshletCount = 0;
     };
 
-    std::vector<GuardPart> guardParts;
+    std::vector<GuardLod> guardLods;
+    int guardLod = 0;
+    glm::vec3 guardCenter = glm::vec3(0.0f);    // object-space bounding sphere
+    float guardRadius = 0.0f;
+
+    // Every LOD is split into meshlets; a compute pass culls the current
+    // level's and writes the survivors as indirect draws.
+    GLuint guardMeshletBuffer = 0;      // SSBO, binding 1
+    GLuint guardCommandBuffer = 0;      // SSBO binding 2, then GL_DRAW_INDIRECT_BUFFER
+    GLuint guardDrawCountBuffer = 0;    // SSBO binding 3, then GL_PARAMETER_BUFFER
+    int guardMaxMeshlets = 0;
+
+    // Loader thread: parse or map the guard, build buffers and the cull program
+    bool loadGuard();
+    void uploadGuard(const ObjModelView& model, const MeshBuffersView& buffers);
+    // Render thread: VAOs are not shared between contexts
+    void buildGuardVao();
 
 public:
     SceneBasic_Uniform();
@@ -83,8 +255,4 @@ public:
     void update(float t) override;
     void render() override;
     void resize(int w, int h) override;
-
-    GLuint guardVao = 0;
-    GLuint guardVbo = 0;
-    int guardVertexCount = 0;
 };
\ No newline at end of file
@@ -1,81 +1,234 @@
 #version 460
-
-in vec3 vWorldPos;
-in vec3 vNormal;
-in vec2 vUV;
+// SPIR-V for OpenGL has no bindless textures; those builds use the arrays
+#ifndef GL_SPIRV
+#extension GL_ARB_bindless_texture : enable
+#endif
+
+layout (location = 0) in vec3 vWorldPos;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec2 vUV;
+layout (location = 3) flat in uint vMaterial;
+layout (location = 4) flat in int vTexSlot;     // -1 for untextured
+layout (location = 5) flat in int vVirtual;     // 1 to sample the virtual texture instead
+layout (location = 6) flat in vec3 vBaseColor;
 
 layout (location = 0) out vec4 FragColor;
 
-uniform vec3 uViewPos;
-uniform vec3 uLightPos;
-uniform vec3 uLightColor;
-
-uniform float uAmbientStrength;
-uniform float uSpecStrength;
-uniform float uShininess;
-
-uniform vec3 uBaseColor;
-
-uniform int uUseTexture;
-uniform sampler2D uTex;
+// Built once per combination of these (see ShaderVariants), each leaving
+// out the code for what it hasn't got. From SPIR-V they are
+// specialization constants, numbered as SceneBasic_Uniform's
+// ShadingFeature bits; from GLSL, USE_TEXTURE, USE_SPOTLIGHT and USE_FOG
+// defines. TEXTURED is for draws where something may be textured.
+#ifdef GL_SPIRV
+layout (constant_id = 0) const bool TEXTURED = false;
+layout (constant_id = 1) const bool SPOTLIGHT = false;
+layout (constant_id = 2) const bool FOG = false;
+#else
+#ifdef USE_TEXTURE
+const bool TEXTURED = true;
+#else
+const bool TEXTURED = false;
+#endif
+#ifdef USE_SPOTLIGHT
+const bool SPOTLIGHT = true;
+#else
+const bool SPOTLIGHT = false;
+#endif
+#ifdef USE_FOG
+const bool FOG = true;
+#else
+const bool FOG = false;
+#endif
+#endif
+
+// As in basic_uniform.vert
+layout (std140, binding = 0) uniform FrameBlock {
+    mat4 view;
+    mat4 proj;
+    vec4 viewPos;       // xyz
+    vec4 lightPos;      // xyz
+    vec4 lightColor;    // rgb; a = ambient strength
+    vec4 spotDir;       // xyz, direction the spotlight points (world space)
+    vec4 fogColor;      // rgb
+    vec4 params;        // x, y = cos of the spotlight's inner, outer angle; z, w = fog near, far
+} frame;
+
+layout (std140, binding = 1) uniform MaterialParams {
+    vec4 specular;      // x = strength, y = shininess
+    ivec4 flags;        // x = 1 to colour by the MTL materials below
+} material;
+
+// MTL materials, indexed per vertex
+struct Material {
+    vec4 kd;    // rgb = Kd, a = d
+    vec4 ks;    // rgb = Ks, a = Ns
+};
+layout (std430, binding = 0) readonly buffer MaterialBlock {
+    Material materials[];
+};
+
+// Material textures by slot, filled by TextureTable: a bindless handle,
+// or a layer of one of uTexArrays, which are one per format. Neither when
+// the texture has been evicted.
+struct TextureSlot {
+    uvec2 handle;
+    float layer;
+    float minLod;       // finest level streamed in so far
+    vec2 size;
+    int array;          // -1 unless in an array
+    float unused;
+};
+layout (std430, binding = 4) readonly buffer TextureBlock {
+    TextureSlot textureSlots[];
+};
+layout (location = 0) uniform int uBindless;
+layout (binding = 0) uniform sampler2DArray uTexArrays[4];     // TextureTable::ARRAY_UNIT onwards
+
+// Virtual texture, see VirtualTexture: per level, a page table entry
+// points at the page's slot in the atlas or at its nearest resident
+// ancestor's
+layout (binding = 4) uniform usampler2D uPageTable;    // PAGE_TABLE_UNIT; xy = atlas slot, z = level held, w = 1 when anything is
+layout (binding = 5) uniform sampler2D uPageAtlas;      // ATLAS_UNIT
+layout (location = 1) uniform int uVirtualPages;        // pages across level 0
+layout (location = 2) uniform int uVirtualLevels;
+layout (location = 3) uniform float uVirtualUvScale;    // mesh UV to virtual UV
+
+const float VT_PAGE_SIZE = 128.0;   // VirtualTexture::PAGE_SIZE
+const float VT_BORDER = 4.0;        // VirtualTexture::BORDER
+
+bool slotResident(int slot)
+{
+    TextureSlot t = textureSlots[slot];
+    return t.array >= 0 || t.handle != uvec2(0);
+}
 
-// Fog
-uniform int uFog;
-uniform vec3  uFogColor;
-uniform float uFogNear;
-uniform float uFogFar;
+vec3 sampleSlot(int slot, vec2 uv)
+{
+    TextureSlot t = textureSlots[slot];
+
+    // Fully streamed in: plain sampling. The slot is the same for the
+    // whole draw, so neither this branch nor the array index splits quads.
+    if (t.minLod <= 0.0) {
+#if defined(GL_ARB_bindless_texture) && !defined(GL_SPIRV)
+        if (uBindless == 1) return texture(sampler2D(t.handle), uv).rgb;
+#endif
+        return texture(uTexArrays[t.array], vec3(uv, t.layer)).rgb;
+    }
 
-// Spotlight
-uniform int  uUseSpotlight;     // 0/1
-uniform vec3 uSpotDir;          // direction the spotlight points (world space)
-uniform float uInnerCutoff;     // cos(radians(innerAngle))
-uniform float uOuterCutoff;     // cos(radians(outerAngle))
+    // Otherwise widen the gradients until the level chosen is one that
+    // has arrived. The minor axis is what anisotropic filtering can go
+    // down to.
+    vec2 dx = dFdx(uv), dy = dFdy(uv);
+    float lod = log2(max(min(length(dx * t.size), length(dy * t.size)), 1e-6));
+    float widen = exp2(max(t.minLod - lod, 0.0));
+    dx *= widen;
+    dy *= widen;
+
+#if defined(GL_ARB_bindless_texture) && !defined(GL_SPIRV)
+    if (uBindless == 1) return textureGrad(sampler2D(t.handle), uv, dx, dy).rgb;
+#endif
+    return textureGrad(uTexArrays[t.array], vec3(uv, t.layer), dx, dy).rgb;
+}
+
+// Bilinear within the page the table gives for uv, in [0, 1), at level
+bool sampleVirtualLevel(vec2 uv, int level, out vec3 color)
+{
+    int across = uVirtualPages >> level;
+    ivec2 page = min(ivec2(uv * float(across)), ivec2(across - 1));
+    uvec4 entry = texelFetch(uPageTable, page, level);
+    if (entry.w == 0u) return false;
+
+    // Where uv lands inside the page actually held, which may be coarser
+    vec2 inPage = fract(uv * float(uVirtualPages >> int(entry.z)));
+    vec2 texel = vec2(entry.xy) * (VT_PAGE_SIZE + 2.0 * VT_BORDER) + VT_BORDER + inPage * VT_PAGE_SIZE;
+    color = textureLod(uPageAtlas, texel / vec2(textureSize(uPageAtlas, 0)), 0.0).rgb;
+    return true;
+}
+
+// Trilinear between the two levels around the footprint; fallback until
+// the first page arrives
+vec3 sampleVirtual(vec2 meshUV, vec3 fallback)
+{
+    vec2 uv = meshUV * uVirtualUvScale;
+    vec2 texel = uv * float(uVirtualPages) * VT_PAGE_SIZE;
+    float lod = log2(max(length(dFdx(texel)), length(dFdy(texel))));
+    lod = clamp(lod, 0.0, float(uVirtualLevels - 1));
+    int level = int(lod);
+    uv = fract(uv);
+
+    vec3 fine, coarse;
+    if (!sampleVirtualLevel(uv, level, fine)) return fallback;
+    if (level + 1 == uVirtualLevels || !sampleVirtualLevel(uv, level + 1, coarse)) return fine;
+    return mix(fine, coarse, fract(lod));
+}
 
 void main()
 {
-    vec3 base = uBaseColor;
-    if (uUseTexture == 1) {
-        base = texture(uTex, vUV).rgb;
+    vec3 base = vBaseColor;
+    vec3 specColor = vec3(material.specular.x);
+    float shininess = material.specular.y;
+    if (TEXTURED && vVirtual == 1) {
+        base = sampleVirtual(vUV, base);
     }
+    else if (TEXTURED && vTexSlot >= 0 && slotResident(vTexSlot)) {
+        base = sampleSlot(vTexSlot, vUV);
+    }
+    else if (material.flags.x == 1) {
+        Material m = materials[vMaterial];
+        base = m.kd.rgb;
+        // Ns 0 means the exporter had no specular setting; keep the scene's
+        if (m.ks.a > 0.0) {
+            specColor = m.ks.rgb;
+            shininess = m.ks.a;
+        }
+    }
+
+    vec3 lightPos = frame.lightPos.xyz;
+    vec3 viewPos = frame.viewPos.xyz;
+    vec3 lightColor = frame.lightColor.rgb;
 
     vec3 N = normalize(vNormal);
-    vec3 L = normalize(uLightPos - vWorldPos);
-    vec3 V = normalize(uViewPos - vWorldPos);
+    vec3 L = normalize(lightPos - vWorldPos);
+    vec3 V = normalize(viewPos - vWorldPos);
     vec3 H = normalize(L + V);
 
     // Spotlight intensity
     float spot = 1.0;
-    if (uUseSpotlight == 1) {
-        vec3 spotDirN = normalize(uSpotDir);
+    if (SPOTLIGHT) {
+        vec3 spotDirN = normalize(frame.spotDir.xyz);
 
         // direction from light -> fragment
-        vec3 lightToFrag = normalize(vWorldPos - uLightPos);
+        vec3 lightToFrag = normalize(vWorldPos - lightPos);
 
         // compare with spotlight direction (pointing from light)
         float theta = dot(lightToFrag, spotDirN);
 
-        float eps = max(uInnerCutoff - uOuterCutoff, 0.0001);
-        spot = clamp((theta - uOuterCutoff) / eps, 0.0, 1.0);
+        float inner = frame.params.x;
+        float outer = frame.params.y;
+        float eps = max(inner - outer, 0.0001);
+        spot = clamp((theta - outer) / eps, 0.0, 1.0);
     }
 
-    vec3 ambient = uAmbientStrength * base * uLightColor;
+    vec3 ambient = frame.lightColor.a * base * lightColor;
 
     float diff = max(dot(N, L), 0.0);
-    vec3 diffuse = diff * base * uLightColor;
+    vec3 diffuse = diff * base * lightColor;
 
     float spec = 0.0;
     if (diff > 0.0) {
-        spec = pow(max(dot(N, H), 0.0), uShininess);
+        spec = pow(max(dot(N, H), 0.0), shininess);
     }
-    vec3 specular = uSpecStrength * spec * uLightColor;
+    vec3 specular = specColor * spec * lightColor;
 
     vec3 color = ambient + spot * (diffuse + specular);
 
     // Fog
-    if (uFog == 1) {
-        float d = length(uViewPos - vWorldPos);
-        float fogFactor = clamp((d - uFogNear) / (uFogFar - uFogNear), 0.0, 1.0);
-        color = mix(color, uFogColor, fogFactor);
+    if (FOG) {
+        float fogNear = frame.params.z;
+        float fogFar = frame.params.w;
+        float d = length(viewPos - vWorldPos);
+        float fogFactor = clamp((d - fogNear) / (fogFar - fogNear), 0.0, 1.0);
+        color = mix(color, frame.fogColor.rgb, fogFactor);
     }
 
     FragColor = vec4(color, 1.0);
@@ -3,23 +3,77 @@
 layout (location = 0) in vec3 VertexPosition;
 layout (location = 1) in vec3 VertexNormal;
 layout (location = 2) in vec2 VertexUV;
+layout (location = 3) in uint VertexMaterial;
 
-out vec3 vWorldPos;
-out vec3 vNormal;
-out vec2 vUV;
+layout (location = 0) out vec3 vWorldPos;
+layout (location = 1) out vec3 vNormal;
+layout (location = 2) out vec2 vUV;
+layout (location = 3) flat out uint vMaterial;
+layout (location = 4) flat out int vTexSlot;
+layout (location = 5) flat out int vVirtual;
+layout (location = 6) flat out vec3 vBaseColor;
 
-uniform mat4 uModel;
-uniform mat4 uView;
-uniform mat4 uProj;
+// Per-frame and per-draw values, written to a ring each frame by
+// SceneBasic_Uniform; FrameBlock is shared with basic_uniform.frag
+layout (std140, binding = 0) uniform FrameBlock {
+    mat4 view;
+    mat4 proj;
+    vec4 viewPos;       // xyz
+    vec4 lightPos;      // xyz
+    vec4 lightColor;    // rgb; a = ambient strength
+    vec4 spotDir;       // xyz, direction the spotlight points (world space)
+    vec4 fogColor;      // rgb
+    vec4 params;        // x, y = cos of the spotlight's inner, outer angle; z, w = fog near, far
+} frame;
+
+layout (std140, binding = 2) uniform ObjectParams {
+    mat4 model;
+    // Packed meshes store positions as unorm16 inside their bounding box
+    vec4 posScale;      // xyz
+    vec4 posOffset;     // xyz
+    vec4 baseColor;     // rgb
+    ivec4 flags;        // x = 1 to read objects[gl_DrawID] instead
+} object;
+
+// Batched objects: one entry per draw of a multi-draw, replacing the
+// block above
+struct ObjectData {
+    mat4 model;
+    vec4 posScale;      // xyz
+    vec4 posOffset;     // xyz
+    vec4 baseColor;     // rgb
+    ivec4 texture;      // x = texture slot, -1 for none; y = 1 for the virtual texture
+};
+layout (std430, binding = 5) readonly buffer ObjectBlock {
+    ObjectData objects[];
+};
 
 void main()
 {
-    vec4 world = uModel * vec4(VertexPosition, 1.0);
+    mat4 model = object.model;
+    vec3 posScale = object.posScale.xyz;
+    vec3 posOffset = object.posOffset.xyz;
+    vBaseColor = object.baseColor.rgb;
+    vTexSlot = -1;
+    vVirtual = 0;
+    if (object.flags.x == 1) {
+        ObjectData o = objects[gl_DrawID];
+        model = o.model;
+        posScale = o.posScale.xyz;
+        posOffset = o.posOffset.xyz;
+        vBaseColor = o.baseColor.rgb;
+        vTexSlot = o.texture.x;
+        vVirtual = o.texture.y;
+    }
+
+    vec3 pos = posOffset + posScale * VertexPosition;
+    vec4 world = model * vec4(pos, 1.0);
     vWorldPos = world.xyz;
 
     // fine as long as you don't scale weirdly
-    vNormal = mat3(uModel) * VertexNormal;
+    vNormal = mat3(model) * VertexNormal;
     vUV = VertexUV;
+    vMaterial = VertexMaterial;
 
-    gl_Position = uProj * uView * world;
+    gl_Position = frame.proj * frame.view * world;
 }
@@ -0,0 +1,36 @@
+#version 460
+
+// Virtual texture feedback: drawn with basic_uniform.vert at a fraction of
+// the screen size, flags each page the ground would sample. VirtualTexture
+// reads the flags back and loads what is missing.
+
+layout (location = 2) in vec2 vUV;     // as in basic_uniform.vert
+
+layout (std430, binding = 6) buffer RequestBlock {
+    uint requests[];        // one per page, level-major
+};
+
+const float PAGE_SIZE = 128.0;      // VirtualTexture::PAGE_SIZE
+
+uniform int uVirtualPages;          // pages across level 0
+uniform int uVirtualLevels;
+uniform float uVirtualUvScale;      // mesh UV to virtual UV
+uniform float uFeedbackLodBias;     // log2 of how much smaller this pass is drawn
+
+void main()
+{
+    // Same level choice as sampleVirtual in basic_uniform.frag
+    vec2 uv = vUV * uVirtualUvScale;
+    vec2 texel = uv * float(uVirtualPages) * PAGE_SIZE;
+    float lod = log2(max(length(dFdx(texel)), length(dFdy(texel)))) - uFeedbackLodBias;
+    int level = clamp(int(floor(lod)), 0, uVirtualLevels - 1);
+
+    int across = uVirtualPages >> level;
+    ivec2 page = min(ivec2(fract(uv) * float(across)), ivec2(across - 1));
+
+    int first = 0;
+    for (int l = 0; l < level; ++l) {
+        first += (uVirtualPages >> l) * (uVirtualPages >> l);
+    }
+    requests[first + page.y * across + page.x] = 1u;
+}